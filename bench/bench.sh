@@ -0,0 +1,244 @@
+#!/bin/sh
+# Benchmark do pré-processador, montador e ligador sobre um corpus sintético.
+#
+# Uso: bench/bench.sh [-l linhas] [-L rotulos] [-m macros] [-p parametros]
+#                     [-x densidade] [-n modulos] [-r repeticoes]
+#                     [-t tolerancia] [-P] [-b revisao]
+#
+# Os parâmetros -l, -L, -m, -p, -x e -n são repassados ao bench/gerador e
+# descrevem o corpus grande. O padrão (-l 76 -L 90 -m 2 -n 2) fica perto dos
+# limites do montador: 90 rótulos mais os EXTERN, de MAX_LABELS = 100, e
+# quase 100 referências pendentes por módulo.
+#   -r  quantas vezes cada etapa é executada, em 10 lotes dos quais vale o
+#       mais rápido (padrão 200)
+#   -t  perda máxima aceita em relação à revisão de -b, em % (padrão 30)
+#   -P  mede somente o pré-processamento (para entradas grandes, na casa
+#       dos GB, que excedem os limites do montador e do ligador)
+#   -b  compila também as ferramentas da revisão git dada e as mede na mesma
+#       execução, na mesma máquina, alternando com as atuais
+#
+# Cada etapa é medida em dois corpora: o grande e um pequeno, com um quarto
+# das linhas e dos rótulos. Um processo por etapa custa o mesmo nos dois,
+# então a diferença entre eles dá o custo marginal por linha (por palavra,
+# na ligação), separado do custo fixo de criar o processo e carregar o
+# executável, que domina os corpora dentro dos limites do montador. O custo
+# marginal é reportado como vazão (linhas/s ou palavras/s). Com -b, o tempo
+# por execução no corpus grande é comparado com o da revisão; se alguma
+# etapa ficar mais lenta que a tolerância, o script termina com código 1.
+#
+# No corpus padrão o pré-processamento é rápido perto da criação do
+# processo, e a linha "preprocess" mostra "< ruído" no lugar da vazão. Para
+# medir como ele escala, use -P com um -l grande, por exemplo
+# bench/bench.sh -P -n 1 -l 200000 -r 20.
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(dirname "$BENCH_DIR")
+
+LINES=76
+LABELS=90
+MACROS=2
+PARAMS=0
+DENSITY=10
+MODULES=2
+REPEAT=200
+TOLERANCE=30
+PRE_ONLY=0
+BASE_REV=""
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -l) LINES=$2; shift 2 ;;
+        -L) LABELS=$2; shift 2 ;;
+        -m) MACROS=$2; shift 2 ;;
+        -p) PARAMS=$2; shift 2 ;;
+        -x) DENSITY=$2; shift 2 ;;
+        -n) MODULES=$2; shift 2 ;;
+        -r) REPEAT=$2; shift 2 ;;
+        -t) TOLERANCE=$2; shift 2 ;;
+        -P) PRE_ONLY=1; shift ;;
+        -b) BASE_REV=$2; shift 2 ;;
+        *)
+            echo "Uso: $0 [-l linhas] [-L rotulos] [-m macros] [-p parametros] [-x densidade] [-n modulos] [-r repeticoes] [-t tolerancia] [-P] [-b revisao]" >&2
+            exit 1 ;;
+    esac
+done
+
+if [ "$MODULES" -gt 2 ]; then
+    echo "Erro: o ligador aceita no máximo dois módulos." >&2
+    exit 1
+fi
+if [ "$LINES" -lt 8 ]; then
+    echo "Erro: o corpus pequeno tem um quarto das linhas; use -l 8 ou mais." >&2
+    exit 1
+fi
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# Compila as ferramentas do diretório $1 em $2 (CFLAGS="-O2 -mavx2" usa AVX2)
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+build_tools() {
+    mkdir -p "$2"
+    $CC $CFLAGS -o "$2/montador" "$1/main.c" "$1/preprocessador.c" "$1/montador.c" -pthread
+    $CC $CFLAGS -o "$2/ligador" "$1/ligador.c"
+}
+
+build_tools "$ROOT_DIR" "$WORK/atual"
+if [ -n "$BASE_REV" ]; then
+    mkdir "$WORK/src-base"
+    git -C "$ROOT_DIR" archive "$BASE_REV" | tar -x -C "$WORK/src-base"
+    build_tools "$WORK/src-base" "$WORK/base"
+fi
+$CC $CFLAGS -o "$WORK/gerador" "$BENCH_DIR/gerador.c"
+
+# Gera os dois corpora em $WORK/pequeno e $WORK/grande
+SMALL_LINES=$((LINES / 4))
+SMALL_LABELS=$(((LABELS + 3) / 4))
+for corpus in pequeno grande; do
+    mkdir "$WORK/$corpus"
+    if [ "$corpus" = pequeno ]; then l=$SMALL_LINES; L=$SMALL_LABELS; else l=$LINES; L=$LABELS; fi
+    (cd "$WORK/$corpus" && "$WORK/gerador" -l "$l" -L "$L" -m "$MACROS" -p "$PARAMS" -x "$DENSITY" \
+        -n "$MODULES" -o gen > sources.txt)
+done
+
+now_ns() {
+    date +%s%N
+}
+
+preprocess_all() {
+    for src in $SOURCES; do "$TOOLS/montador" "$src"; done
+}
+
+assemble_all() {
+    for src in $SOURCES; do "$TOOLS/montador" "${src%.asm}.pre"; done
+}
+
+# Com um módulo o montador já gera código final, sem etapa de ligação
+link_all() {
+    if [ "$MODULES" -eq 2 ]; then
+        "$TOOLS/ligador" gen1.obj gen2.obj
+    fi
+}
+
+# Executa a etapa $3 REPEAT vezes no corpus $1 com as ferramentas de $2, em
+# BATCHES lotes, e imprime o tempo médio por execução do lote mais rápido,
+# em nanossegundos (o mínimo descarta os lotes atrapalhados pelo resto da
+# máquina)
+BATCHES=10
+if [ "$REPEAT" -lt "$BATCHES" ]; then BATCHES=$REPEAT; fi
+measure() {
+    cd "$WORK/$1"
+    TOOLS="$WORK/$2"
+    SOURCES=$(cat sources.txt)
+    runs=$((REPEAT / BATCHES))
+    best=""
+    b=0
+    while [ "$b" -lt "$BATCHES" ]; do
+        start=$(now_ns)
+        i=0
+        while [ "$i" -lt "$runs" ]; do
+            $3 > /dev/null
+            i=$((i + 1))
+        done
+        end=$(now_ns)
+        t=$(((end - start) / runs))
+        if [ -z "$best" ] || [ "$t" -lt "$best" ]; then best=$t; fi
+        b=$((b + 1))
+    done
+    echo "$best"
+}
+
+# Gera uma vez para conhecer os tamanhos de cada corpus: linhas do .asm,
+# linhas expandidas (.pre) e palavras do executável
+corpus_size() {
+    cd "$WORK/$1"
+    TOOLS="$WORK/atual"
+    SOURCES=$(cat sources.txt)
+    preprocess_all > /dev/null
+    if [ "$PRE_ONLY" -eq 0 ]; then
+        assemble_all > /dev/null
+        link_all > /dev/null
+    fi
+    asm_lines=$(cat $SOURCES | wc -l)
+    pre_lines=0
+    for src in $SOURCES; do
+        pre_lines=$((pre_lines + $(wc -l < "${src%.asm}.pre")))
+    done
+    exe_words=0
+    if [ "$PRE_ONLY" -eq 0 ] && [ "$MODULES" -eq 2 ]; then
+        exe_words=$(wc -w < gen1.e)
+    fi
+    echo "$asm_lines $pre_lines $exe_words"
+}
+
+set -- $(corpus_size pequeno)
+S_LINES=$1; S_PRE=$2; S_WORDS=$3
+set -- $(corpus_size grande)
+L_LINES=$1; L_PRE=$2; L_WORDS=$3
+
+echo "Corpus pequeno: $S_LINES linhas, $S_PRE expandidas, $S_WORDS palavras executáveis"
+echo "Corpus grande:  $L_LINES linhas, $L_PRE expandidas, $L_WORDS palavras executáveis ($REPEAT repetições)"
+
+STAGES="preprocess_all"
+if [ "$PRE_ONLY" -eq 0 ]; then
+    STAGES="$STAGES assemble_all"
+    if [ "$MODULES" -eq 2 ]; then STAGES="$STAGES link_all"; fi
+fi
+
+# Custo fixo e vazão marginal a partir dos tempos nos dois corpora:
+# tempo = fixo + quantidade / vazão. Se a diferença entre os corpora é menor
+# que 5% do tempo, ela se confunde com a variação da criação de processos e a
+# vazão não é estimada
+fit() {
+    awk -v ts="$1" -v tl="$2" -v ns="$3" -v nl="$4" 'BEGIN {
+        per = (tl - ts) / (nl - ns)
+        fixed = ts - per * ns
+        if(tl - ts > ts * 0.05) printf "%.1f %.0f", fixed / 1e3, 1e9 / per
+        else printf "- <ruído"
+    }'
+}
+
+us() {
+    awk -v t="$1" 'BEGIN { printf "%.1f", t / 1e3 }'
+}
+
+printf "%-12s %12s %12s %10s %22s" "etapa" "pequeno(us)" "grande(us)" "fixo(us)" "marginal"
+if [ -n "$BASE_REV" ]; then printf " %14s %9s" "$BASE_REV(us)" "variacao"; fi
+printf "\n"
+
+STATUS=0
+for stage in $STAGES; do
+    case "$stage" in
+        preprocess_all) name="preprocess"; ns=$S_LINES; nl=$L_LINES; unit="linhas/s" ;;
+        assemble_all)   name="assemble";   ns=$S_LINES; nl=$L_LINES; unit="linhas/s" ;;
+        link_all)       name="link";       ns=$S_WORDS; nl=$L_WORDS; unit="palavras/s" ;;
+    esac
+
+    # A revisão de -b é medida logo depois da versão atual no corpus
+    # grande, para que variações da máquina afetem as duas igualmente
+    ts=$(measure pequeno atual "$stage")
+    tl=$(measure grande atual "$stage")
+    if [ -n "$BASE_REV" ]; then bl=$(measure grande base "$stage"); fi
+
+    set -- $(fit "$ts" "$tl" "$ns" "$nl")
+    if [ "$1" = "-" ]; then marginal="< ruído"; else marginal="$2 $unit"; fi
+    printf "%-12s %12s %12s %10s %22s" "$name" "$(us "$ts")" "$(us "$tl")" "$1" "$marginal"
+
+    # A comparação usa o tempo por execução no corpus grande, que inclui o
+    # custo fixo: uma regressão nele é sentida por quem usa as ferramentas
+    if [ -n "$BASE_REV" ]; then
+        delta=$(awk -v v="$tl" -v b="$bl" 'BEGIN { printf "%+.1f%%", (v - b) * 100 / b }')
+        printf " %14s %9s\n" "$(us "$bl")" "$delta"
+        if awk -v v="$tl" -v b="$bl" -v t="$TOLERANCE" 'BEGIN { exit !(v > b * (1 + t / 100)) }'; then
+            echo "REGRESSÃO: $name ficou mais de $TOLERANCE% mais lento que em $BASE_REV." >&2
+            STATUS=1
+        fi
+    else
+        printf "\n"
+    fi
+done
+
+exit $STATUS
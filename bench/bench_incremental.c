@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "../montador.h"
+
+// Benchmark da sessão de montagem incremental (montador -w).
+//
+// Uso:
+//   gcc -O2 -o bench_incremental bench/bench_incremental.c montador.c
+//   ./bench_incremental [edicoes] [semente]
+//
+// Gera um módulo perto dos limites do montador (palavras, rótulos e
+// referências), aplica edições aleatórias de uma linha (trocar, inserir ou
+// apagar instruções e, de vez em quando, trocar uma declaração PUBLIC) e a
+// cada edição compara a saída de tentar_atualizar_sessao/gravar_sessao, o
+// caminho do -w, com a de montar_programa, byte a byte. Reporta o tempo médio
+// por edição dos dois, gravando em /dev/null para medir a montagem e não a
+// criação de arquivos. A cada BROKEN_EVERY edições grava também uma versão
+// com erro de montagem, que a sessão deve recusar e desfazer, continuando
+// com a saída da versão anterior.
+
+#define MAX_DOC_LINES 2048
+#define TEXT_LABELS   40
+#define DATA_LABELS   40
+#define WORD_LIMIT    1000   // Mantém o código abaixo de MAX_CODE_SIZE
+#define BROKEN_EVERY  32
+
+// Linhas com erro: rótulo indefinido (depois de trocar as linhas), sintaxe
+// de rótulo (ao separar os tokens, antes de trocar) e operandos a mais
+static const char *broken_lines[] = {"JMP NENHUM", ": STOP", "LOAD D0,D1"};
+
+static char doc[MAX_DOC_LINES][128];
+static int doc_lines;
+static int first_text, last_text;   // Linhas de instrução: [first_text, last_text)
+static int first_public;            // Primeira linha PUBLIC
+static int words;
+
+static const char *SOURCE = "bench_incremental.pre";
+static const char *FULL_OUTPUT = "bench_incremental_completa.obj";
+static const char *SESSION_OUTPUT = "bench_incremental_sessao.obj";
+
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Instrução aleatória com 'refs' referências a rótulos; devolve as palavras
+static int random_instruction(char *out, int refs)
+{
+    static const char *ops[] = {"ADD", "SUB", "MULT", "LOAD", "STORE", "OUTPUT", "INPUT"};
+    static const char *jumps[] = {"JMP", "JMPN", "JMPP", "JMPZ"};
+    int choice = rand() % 4;
+    if(refs == 0) {
+        switch(choice) {
+            case 0:  sprintf(out, "STOP"); return 1;
+            case 1:  sprintf(out, "COPY %d,%d", rand() % 900, rand() % 900); return 3;
+            case 2:  sprintf(out, "%s 0x%x", ops[rand() % 7], rand() % 900); return 2;
+            default: sprintf(out, "%s %d", ops[rand() % 7], rand() % 900); return 2;
+        }
+    }
+    if(refs == 2) {
+        sprintf(out, "COPY D%d,D%d+%d", rand() % DATA_LABELS, rand() % DATA_LABELS, rand() % 3);
+        return 3;
+    }
+    switch(choice) {
+        case 0:  sprintf(out, "%s L%d", jumps[rand() % 4], rand() % TEXT_LABELS); return 2;
+        case 1:  sprintf(out, "COPY D%d,%d", rand() % DATA_LABELS, rand() % 900); return 3;
+        case 2:  sprintf(out, "LOAD EXT+%d", rand() % 4); return 2;
+        default: sprintf(out, "%s D%d", ops[rand() % 7], rand() % DATA_LABELS); return 2;
+    }
+}
+
+static int count_refs(const char *line)
+{
+    const char *body = strchr(line, ':') ? strchr(line, ':') + 2 : line;
+    if(strncmp(body, "COPY D", 6) == 0) return strstr(body, ",D") ? 2 : 1;
+    const char *operand = strchr(body, ' ');
+    return (operand && (operand[1] == 'L' || operand[1] == 'D' || operand[1] == 'E')) ? 1 : 0;
+}
+
+static int line_words(const char *line)
+{
+    const char *body = strchr(line, ':') ? strchr(line, ':') + 2 : line;
+    if(strncmp(body, "STOP", 4) == 0) return 1;
+    if(strncmp(body, "COPY", 4) == 0) return 3;
+    return 2;
+}
+
+// Módulo inicial: declarações, instruções com rótulos espalhados e dados
+static void generate(void)
+{
+    char instr[64];
+    doc_lines = 0;
+    sprintf(doc[doc_lines++], "MOD: BEGIN");
+    first_public = doc_lines;
+    for(int i = 0; i < 4; i++) sprintf(doc[doc_lines++], "PUBLIC L%d", i * 10);
+    sprintf(doc[doc_lines++], "EXT: EXTERN");
+    sprintf(doc[doc_lines++], "SECTION TEXT");
+
+    first_text = doc_lines;
+    int refs = 0;
+    words = 0;
+    for(int i = 0; words < 900; i++) {
+        int want = (refs < 95 && i % 4 == 0) ? 1 : 0;
+        words += random_instruction(instr, want);
+        refs += want;
+        if(i % 10 == 0 && i / 10 < TEXT_LABELS) {
+            sprintf(doc[doc_lines++], "L%d: %s", i / 10, instr);
+        } else {
+            sprintf(doc[doc_lines++], "%s", instr);
+        }
+    }
+    last_text = doc_lines;
+
+    sprintf(doc[doc_lines++], "SECTION DATA");
+    for(int i = 0; i < DATA_LABELS; i++) {
+        if(i % 2) sprintf(doc[doc_lines++], "D%d: SPACE", i);
+        else sprintf(doc[doc_lines++], "D%d: CONST %d", i, i * 3);
+        words++;
+    }
+    sprintf(doc[doc_lines++], "END");
+}
+
+static void write_source(void)
+{
+    FILE *fp = fopen(SOURCE, "w");
+    if(!fp) {
+        perror(SOURCE);
+        exit(1);
+    }
+    for(int i = 0; i < doc_lines; i++) fprintf(fp, "%s\n", doc[i]);
+    fclose(fp);
+}
+
+// Uma edição aleatória que mantém o número de referências e os limites
+static void random_edit(int edit)
+{
+    char instr[64];
+    if(edit % 16 == 15) {
+        // Troca a declaração PUBLIC: a sessão refaz os símbolos
+        int line = first_public + rand() % 4;
+        sprintf(doc[line], "PUBLIC L%d", rand() % TEXT_LABELS);
+        return;
+    }
+
+    int line = first_text + rand() % (last_text - first_text);
+    int kind = rand() % 4;
+    if(kind == 0 && words + 3 < WORD_LIMIT && doc_lines < MAX_DOC_LINES) {
+        // Insere uma instrução sem rótulos
+        memmove(doc[line + 1], doc[line], (size_t)(doc_lines - line) * sizeof(doc[0]));
+        words += random_instruction(doc[line], 0);
+        doc_lines++;
+        last_text++;
+    } else if(kind == 1 && !strchr(doc[line], ':') && count_refs(doc[line]) == 0 &&
+              last_text - first_text > 1) {
+        // Apaga uma instrução sem rótulos
+        words -= line_words(doc[line]);
+        memmove(doc[line], doc[line + 1], (size_t)(doc_lines - line - 1) * sizeof(doc[0]));
+        doc_lines--;
+        last_text--;
+    } else {
+        // Troca uma instrução, mantendo o rótulo definido na linha
+        int refs = count_refs(doc[line]);
+        int old_words = line_words(doc[line]);
+        int new_words = random_instruction(instr, refs);
+        if(words - old_words + new_words >= WORD_LIMIT) return;
+        words += new_words - old_words;
+        char *colon = strchr(doc[line], ':');
+        if(colon) sprintf(colon + 1, " %s", instr);
+        else sprintf(doc[line], "%s", instr);
+    }
+}
+
+static int same_file(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+    if(!fa || !fb) return 0;
+    int ca, cb;
+    do {
+        ca = fgetc(fa);
+        cb = fgetc(fb);
+    } while(ca == cb && ca != EOF);
+    fclose(fa);
+    fclose(fb);
+    return ca == cb;
+}
+
+// Troca uma instrução por uma linha com erro e confere que a sessão recusa
+// a versão e continua igual à anterior (a de FULL_OUTPUT); devolve o tempo
+static double broken_edit(AssemblySession *session, int edit)
+{
+    int line = first_text + rand() % (last_text - first_text);
+    char saved[128];
+    strcpy(saved, doc[line]);
+    strcpy(doc[line], broken_lines[(edit / BROKEN_EVERY) % 3]);
+    write_source();
+
+    // As mensagens de erro do montador são esperadas
+    fflush(stderr);
+    int err = dup(2);
+    freopen("/dev/null", "w", stderr);
+    SessionUpdate update;
+    double start = now_s();
+    int ok = tentar_atualizar_sessao(session, SOURCE, &update);
+    double elapsed = now_s() - start;
+    fflush(stderr);
+    dup2(err, 2);
+    close(err);
+
+    strcpy(doc[line], saved);
+    write_source();
+    gravar_sessao(session, SESSION_OUTPUT);
+    if(ok || !same_file(FULL_OUTPUT, SESSION_OUTPUT)) {
+        fprintf(stderr, "ERRO: versão com erro não foi desfeita na edição %d ('%s').\n",
+                edit, broken_lines[(edit / BROKEN_EVERY) % 3]);
+        exit(1);
+    }
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    int edits = (argc > 1) ? atoi(argv[1]) : 2000;
+    srand((argc > 2) ? (unsigned)atoi(argv[2]) : 1u);
+
+    generate();
+    write_source();
+    AssemblySession *session = iniciar_sessao(SOURCE);
+
+    double t_full = 0, t_session = 0, t_broken = 0;
+    long lexed = 0, resolved = 0, rebuilt = 0;
+    int broken = 0;
+    for(int e = 0; e < edits; e++) {
+        if(e % BROKEN_EVERY == BROKEN_EVERY - 1) {
+            t_broken += broken_edit(session, e);
+            broken++;
+        }
+        random_edit(e);
+        write_source();
+
+        double start = now_s();
+        montar_programa(SOURCE, "/dev/null");
+        t_full += now_s() - start;
+
+        start = now_s();
+        SessionUpdate update;
+        if(!tentar_atualizar_sessao(session, SOURCE, &update)) {
+            fprintf(stderr, "ERRO: a sessão recusou a edição %d (veja %s).\n", e, SOURCE);
+            return 1;
+        }
+        gravar_sessao(session, "/dev/null");
+        t_session += now_s() - start;
+
+        montar_programa(SOURCE, FULL_OUTPUT);
+        gravar_sessao(session, SESSION_OUTPUT);
+
+        lexed += update.lexed;
+        resolved += update.resolved;
+        rebuilt += update.rebuilt;
+        if(!same_file(FULL_OUTPUT, SESSION_OUTPUT)) {
+            fprintf(stderr, "ERRO: saídas diferentes após a edição %d (veja %s).\n", e, SOURCE);
+            return 1;
+        }
+    }
+    encerrar_sessao(session);
+    remove(SOURCE);
+    remove(FULL_OUTPUT);
+    remove(SESSION_OUTPUT);
+
+    printf("Módulo: %d linhas, %d palavras; %d edições, saídas idênticas\n", doc_lines, words, edits);
+    printf("Montagem completa:    %8.1f us/edição\n", t_full / edits * 1e6);
+    printf("Sessão incremental:   %8.1f us/edição (%.2fx)\n", t_session / edits * 1e6,
+           t_session > 0 ? t_full / t_session : 0.0);
+    printf("Por edição: %.1f linhas relidas, %.1f referências resolvidas, %ld reconstruções\n",
+           (double)lexed / edits, (double)resolved / edits, rebuilt);
+    if(broken > 0) {
+        printf("Versões com erro:     %8.1f us/edição (%d, todas desfeitas)\n",
+               t_broken / broken * 1e6, broken);
+    }
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Gerador de programas Assembly sintéticos para medir a escalabilidade
+// do pré-processador, do montador e do ligador.
+//
+// Uso:
+//   gerador [-l linhas] [-L rotulos] [-m macros] [-p parametros]
+//           [-x densidade] [-n modulos] [-s semente] [-o prefixo]
+//
+//   -l  linhas de instrução por módulo (padrão 40)
+//   -L  rótulos por módulo, divididos entre TEXT e DATA (padrão 16)
+//   -m  macros definidas por módulo; a cada 10 linhas uma é chamada (padrão 2)
+//   -p  parâmetros por macro; com -p > 0 as macros ímpares também chamam a
+//       macro anterior, exercitando a expansão aninhada (padrão 0)
+//   -x  porcentagem de operandos que usam símbolos EXTERN (padrão 10)
+//   -n  número de módulos; com 1 gera um programa sem BEGIN/END (padrão 2)
+//   -s  semente do gerador pseudoaleatório (padrão 1)
+//   -o  prefixo dos arquivos gerados (padrão "gen")
+//
+// Com um módulo é gerado <prefixo>.asm; com N módulos, <prefixo>1.asm até
+// <prefixo>N.asm. Os símbolos públicos do módulo k são usados como EXTERN
+// pelo módulo k-1 (circularmente), de modo que os módulos se ligam entre si.
+
+typedef struct {
+    int lines;      // linhas de instrução por módulo
+    int labels;     // rótulos por módulo
+    int macros;     // macros por módulo
+    int params;     // parâmetros por macro
+    int density;    // % de operandos externos
+    int modules;    // quantidade de módulos
+    unsigned seed;  // semente
+    const char *prefix;
+} GenConfig;
+
+// Gerador congruencial linear simples (reprodutível entre plataformas)
+static unsigned rng_state = 1;
+
+static unsigned next_rand(void)
+{
+    rng_state = rng_state * 1103515245u + 12345u;
+    return (rng_state >> 16) & 0x7fff;
+}
+
+// Instruções de um operando usadas no corpo do programa
+static const char *data_ops[] = { "LOAD", "ADD", "SUB", "MULT", "STORE", "OUTPUT", "INPUT" };
+static const char *jump_ops[] = { "JMP", "JMPN", "JMPP", "JMPZ" };
+
+// Quantidade de rótulos de dados de cada módulo
+static int data_label_count(const GenConfig *cfg)
+{
+    int n = cfg->labels / 2;
+    return n < 1 ? 1 : n;
+}
+
+// Quantidade de rótulos de texto (alvos de salto) de cada módulo
+static int text_label_count(const GenConfig *cfg)
+{
+    int n = cfg->labels - data_label_count(cfg);
+    return n < 1 ? 1 : n;
+}
+
+// Quantidade de rótulos de dados que cada módulo exporta
+static int public_count(const GenConfig *cfg)
+{
+    if(cfg->modules < 2 || cfg->density <= 0) return 0;
+    int n = data_label_count(cfg) * cfg->density / 100;
+    return n < 1 ? 1 : n;
+}
+
+// Escolhe um operando de dados: local ou externo, conforme a densidade
+static void pick_operand(const GenConfig *cfg, int module, char *out, size_t out_size)
+{
+    int npub = public_count(cfg);
+    if(npub > 0 && (int)(next_rand() % 100) < cfg->density) {
+        int other = (module + 1) % cfg->modules;
+        snprintf(out, out_size, "M%dD%d", other, (int)(next_rand() % npub));
+    } else {
+        snprintf(out, out_size, "M%dD%d", module, (int)(next_rand() % data_label_count(cfg)));
+    }
+}
+
+// Escreve um módulo completo no arquivo
+static void generate_module(const GenConfig *cfg, int module, FILE *out)
+{
+    int is_module = (cfg->modules > 1);
+    int ndata = data_label_count(cfg);
+    int ntext = text_label_count(cfg);
+    int npub  = public_count(cfg);
+    char op1[32], op2[32];
+
+    fprintf(out, "; modulo sintetico %d (gerado por bench/gerador)\n", module);
+
+    // Definições de macros (corpo de três linhas); os operandos usam os
+    // parâmetros &P0, &P1, ... quando houver
+    for(int m = 0; m < cfg->macros; m++) {
+        fprintf(out, "MACRO M%dMAC%d", module, m);
+        for(int p = 0; p < cfg->params; p++) {
+            fprintf(out, p == 0 ? " &P%d" : ", &P%d", p);
+        }
+        fprintf(out, "\n");
+
+        static const char *body_ops[] = { "LOAD", "ADD", "STORE" };
+        for(int b = 0; b < 3; b++) {
+            if(cfg->params > 0) {
+                snprintf(op1, sizeof(op1), "&P%d", b % cfg->params);
+            } else {
+                pick_operand(cfg, module, op1, sizeof(op1));
+            }
+            fprintf(out, "    %s %s\n", body_ops[b], op1);
+        }
+        if(cfg->params > 0 && m % 2 == 1) {
+            fprintf(out, "    M%dMAC%d", module, m - 1);
+            for(int p = 0; p < cfg->params; p++) {
+                fprintf(out, p == 0 ? " &P%d" : ", &P%d", p);
+            }
+            fprintf(out, "\n");
+        }
+        fprintf(out, "ENDMACRO\n");
+    }
+
+    fprintf(out, "SECTION TEXT\n");
+    if(is_module) {
+        fprintf(out, "MOD%d: BEGIN\n", module);
+        for(int i = 0; i < npub; i++) {
+            fprintf(out, "PUBLIC M%dD%d\n", module, i);
+        }
+        int other = (module + 1) % cfg->modules;
+        for(int i = 0; i < npub; i++) {
+            fprintf(out, "EXTERN M%dD%d\n", other, i);
+        }
+    }
+
+    // Rótulos de texto distribuídos uniformemente entre as linhas
+    int stride = cfg->lines / ntext;
+    if(stride < 1) stride = 1;
+    int next_label = 0;
+
+    for(int i = 0; i < cfg->lines; i++) {
+        int is_call = (cfg->macros > 0 && i % 10 == 9);
+
+        // Chamadas de macro precisam ocupar a linha inteira, então o rótulo
+        // vai numa linha própria
+        if(next_label < ntext && i % stride == 0) {
+            fprintf(out, is_call ? "M%dL%d:\n" : "M%dL%d: ", module, next_label++);
+        }
+
+        if(is_call) {
+            fprintf(out, "M%dMAC%d", module, (i / 10) % cfg->macros);
+            for(int p = 0; p < cfg->params; p++) {
+                pick_operand(cfg, module, op1, sizeof(op1));
+                fprintf(out, p == 0 ? " %s" : ", %s", op1);
+            }
+            fprintf(out, "\n");
+        }
+        else if(i % 13 == 12) {
+            snprintf(op1, sizeof(op1), "M%dL%d", module, (int)(next_rand() % ntext));
+            fprintf(out, "%s %s\n", jump_ops[next_rand() % 4], op1);
+        }
+        else if(i % 7 == 6) {
+            pick_operand(cfg, module, op1, sizeof(op1));
+            pick_operand(cfg, module, op2, sizeof(op2));
+            fprintf(out, "COPY %s,%s\n", op1, op2);
+        }
+        else {
+            pick_operand(cfg, module, op1, sizeof(op1));
+            fprintf(out, "%s %s\n", data_ops[next_rand() % 7], op1);
+        }
+    }
+    // Rótulos de texto que não couberam nas linhas ficam no STOP final
+    while(next_label < ntext) {
+        fprintf(out, "M%dL%d:\n", module, next_label++);
+    }
+    fprintf(out, "STOP\n");
+    if(is_module) {
+        fprintf(out, "END\n");
+    }
+
+    fprintf(out, "SECTION DATA\n");
+    for(int i = 0; i < ndata; i++) {
+        if(i % 2 == 0) {
+            fprintf(out, "M%dD%d: SPACE\n", module, i);
+        } else {
+            fprintf(out, "M%dD%d: CONST %d\n", module, i, (int)(next_rand() % 100));
+        }
+    }
+}
+
+static int parse_int_arg(const char *opt, const char *val, int min)
+{
+    char *end;
+    long v = strtol(val, &end, 10);
+    if(*end != '\0' || v < min) {
+        fprintf(stderr, "Valor inválido para %s: '%s'\n", opt, val);
+        exit(1);
+    }
+    return (int)v;
+}
+
+int main(int argc, char *argv[])
+{
+    GenConfig cfg = { 40, 16, 2, 0, 10, 2, 1, "gen" };
+
+    for(int i = 1; i < argc; i++) {
+        if(i + 1 >= argc) {
+            fprintf(stderr, "Opção '%s' sem valor.\n", argv[i]);
+            exit(1);
+        }
+        const char *opt = argv[i];
+        const char *val = argv[++i];
+        if(strcmp(opt, "-l") == 0)      cfg.lines   = parse_int_arg(opt, val, 1);
+        else if(strcmp(opt, "-L") == 0) cfg.labels  = parse_int_arg(opt, val, 2);
+        else if(strcmp(opt, "-m") == 0) cfg.macros  = parse_int_arg(opt, val, 0);
+        else if(strcmp(opt, "-p") == 0) cfg.params  = parse_int_arg(opt, val, 0);
+        else if(strcmp(opt, "-x") == 0) cfg.density = parse_int_arg(opt, val, 0);
+        else if(strcmp(opt, "-n") == 0) cfg.modules = parse_int_arg(opt, val, 1);
+        else if(strcmp(opt, "-s") == 0) cfg.seed    = (unsigned)parse_int_arg(opt, val, 0);
+        else if(strcmp(opt, "-o") == 0) cfg.prefix  = val;
+        else {
+            fprintf(stderr, "Uso: %s [-l linhas] [-L rotulos] [-m macros] [-p parametros] [-x densidade] "
+                            "[-n modulos] [-s semente] [-o prefixo]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if(cfg.density > 100) cfg.density = 100;
+    rng_state = cfg.seed;
+
+    for(int m = 0; m < cfg.modules; m++) {
+        char filename[512];
+        if(cfg.modules == 1) {
+            snprintf(filename, sizeof(filename), "%s.asm", cfg.prefix);
+        } else {
+            snprintf(filename, sizeof(filename), "%s%d.asm", cfg.prefix, m + 1);
+        }
+
+        FILE *out = fopen(filename, "w");
+        if(!out) {
+            perror("Erro ao criar arquivo de saída");
+            exit(1);
+        }
+        generate_module(&cfg, m, out);
+        fclose(out);
+        printf("%s\n", filename);
+    }
+
+    return 0;
+}
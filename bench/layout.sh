@@ -0,0 +1,67 @@
+#!/bin/sh
+# Mede o ganho do layout guiado por perfil (ligador -p) no simulador.
+#
+# Uso: bench/layout.sh [-n iteracoes] [-P iteracoes_perfil]
+#
+# Monta bench/layout1.asm e bench/layout2.asm, liga no layout original,
+# executa uma vez com poucas iterações para gerar o perfil (simulador -p),
+# religa com ligador -p e compara o tempo das duas versões no simulador.
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(dirname "$BENCH_DIR")
+
+ITERATIONS=20000000
+PROFILE_ITERATIONS=1000
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -n) ITERATIONS=$2; shift 2 ;;
+        -P) PROFILE_ITERATIONS=$2; shift 2 ;;
+        *)
+            echo "Uso: $0 [-n iteracoes] [-P iteracoes_perfil]" >&2
+            exit 1 ;;
+    esac
+done
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+$CC $CFLAGS -o "$WORK/montador" "$ROOT_DIR/main.c" "$ROOT_DIR/preprocessador.c" "$ROOT_DIR/montador.c" -pthread
+$CC $CFLAGS -o "$WORK/ligador" "$ROOT_DIR/ligador.c"
+$CC $CFLAGS -o "$WORK/simulador" "$ROOT_DIR/simulador.c"
+
+cd "$WORK"
+for m in layout1 layout2; do
+    cp "$BENCH_DIR/$m.asm" .
+    ./montador "$m.asm" > /dev/null
+    ./montador "$m.pre" > /dev/null
+done
+
+./ligador -o original.e layout1.obj layout2.obj > /dev/null
+echo "$PROFILE_ITERATIONS" | ./simulador -p perfil.txt original.e > /dev/null
+./ligador -p perfil.txt -o perfil.e layout1.obj layout2.obj > /dev/null
+
+# Executa o simulador com -v e imprime "instruções segundos"
+run() {
+    echo "$ITERATIONS" | ./simulador -v "$1" 2> stats.txt > "$1.out"
+    awk '{ print $3, $5 }' stats.txt
+}
+
+set -- $(run original.e)
+BASE_INSTR=$1; BASE_TIME=$2
+set -- $(run perfil.e)
+PGO_INSTR=$1; PGO_TIME=$2
+
+if ! cmp -s original.e.out perfil.e.out; then
+    echo "ERRO: as saídas dos dois layouts diferem." >&2
+    exit 1
+fi
+
+printf "%-10s %14s %10s\n" "layout" "instruções" "tempo (s)"
+printf "%-10s %14s %10s\n" "original" "$BASE_INSTR" "$BASE_TIME"
+printf "%-10s %14s %10s\n" "perfil" "$PGO_INSTR" "$PGO_TIME"
+awk -v b="$BASE_TIME" -v p="$PGO_TIME" 'BEGIN { printf "speedup %.2fx\n", b / p }'
@@ -0,0 +1,28 @@
+; Programa para o benchmark de layout guiado por perfil (bench/layout.sh).
+; Lê N e executa o laço N vezes; o corpo salta entre os dois módulos e o
+; código de erro fica no meio do caminho quente.
+SECTION TEXT
+PRINC: BEGIN
+PUBLIC LACO
+PUBLIC N
+PUBLIC SOMA
+EXTERN PASSO
+INPUT N
+LACO: LOAD N
+JMPZ FIM
+JMP CORPO
+ERRO: OUTPUT N        ; Nunca executado
+LOAD N
+SUB N
+JMP FIM
+CORPO: LOAD N
+SUB UM
+STORE N
+JMP PASSO
+FIM: OUTPUT SOMA
+STOP
+END
+SECTION DATA
+N: SPACE
+UM: CONST 1
+SOMA: SPACE
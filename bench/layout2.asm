@@ -0,0 +1,15 @@
+; Segundo módulo do benchmark de layout (bench/layout.sh)
+SECTION TEXT
+AUX: BEGIN
+PUBLIC PASSO
+EXTERN LACO
+EXTERN SOMA
+FRIO: OUTPUT SOMA     ; Nunca executado
+STOP
+PASSO: LOAD SOMA
+ADD INCR
+STORE SOMA
+JMP LACO
+END
+SECTION DATA
+INCR: CONST 1
@@ -0,0 +1,69 @@
+#!/bin/sh
+# Mede o ganho das superinstruções do simulador.
+#
+# Uso: bench/super.sh [-n iteracoes] [-P iteracoes_perfil]
+#
+# Monta e liga bench/layout1.asm e bench/layout2.asm e executa o programa
+# sem superinstruções (simulador -n), com a tabela estática (padrão) e com
+# as superinstruções escolhidas pelo perfil (simulador -p, depois -F),
+# comparando instruções, despachos, tempo e MIPS.
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(dirname "$BENCH_DIR")
+
+ITERATIONS=20000000
+PROFILE_ITERATIONS=1000
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+        -n) ITERATIONS=$2; shift 2 ;;
+        -P) PROFILE_ITERATIONS=$2; shift 2 ;;
+        *)
+            echo "Uso: $0 [-n iteracoes] [-P iteracoes_perfil]" >&2
+            exit 1 ;;
+    esac
+done
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+$CC $CFLAGS -o "$WORK/montador" "$ROOT_DIR/main.c" "$ROOT_DIR/preprocessador.c" "$ROOT_DIR/montador.c" -pthread
+$CC $CFLAGS -o "$WORK/ligador" "$ROOT_DIR/ligador.c"
+$CC $CFLAGS -o "$WORK/simulador" "$ROOT_DIR/simulador.c"
+
+cd "$WORK"
+for m in layout1 layout2; do
+    cp "$BENCH_DIR/$m.asm" .
+    ./montador "$m.asm" > /dev/null
+    ./montador "$m.pre" > /dev/null
+done
+
+./ligador -o prog.e layout1.obj layout2.obj > /dev/null
+echo "$PROFILE_ITERATIONS" | ./simulador -p perfil.txt prog.e > /dev/null
+
+# Executa o simulador com -v e as opções dadas; imprime
+# "instruções segundos mips despachos" e grava a saída em <nome>.out
+run() {
+    name=$1; shift
+    echo "$ITERATIONS" | ./simulador -v "$@" prog.e 2> stats.txt > "$name.out"
+    awk 'NR == 1 { i = $3; t = $5; m = substr($7, 2) } NR == 2 { d = $2 }
+         END { print i, t, m, d }' stats.txt
+}
+
+printf "%-10s %14s %14s %10s %8s\n" "modo" "instruções" "despachos" "tempo (s)" "MIPS"
+for mode in nenhuma estatica perfil; do
+    case $mode in
+        nenhuma)  set -- $(run $mode -n) ;;
+        estatica) set -- $(run $mode) ;;
+        perfil)   set -- $(run $mode -F perfil.txt) ;;
+    esac
+    printf "%-10s %14s %14s %10s %8s\n" "$mode" "$1" "$4" "$2" "$3"
+    if ! cmp -s nenhuma.out "$mode.out"; then
+        echo "ERRO: a saída com superinstruções ($mode) difere." >&2
+        exit 1
+    fi
+done
@@ -4,6 +4,7 @@
 
 #define MAX_SYM 100
 #define MAX_CODE 1024
+#define MAX_SHARED 8    // Módulos compartilhados (-l) por executável
 
 // Estruturas principais do ligador
 typedef struct {
@@ -14,8 +15,33 @@ typedef struct {
 typedef struct {
     char symbol[50];
     int  address;  // posição no código onde o símbolo é usado
+    int  addend;   // deslocamento somado ao endereço do símbolo (SIMBOLO+N)
 } Usage;
 
+// Módulo compartilhado usado com -l: só a tabela de definições interessa
+typedef struct {
+    char filename[256];
+    Definition def_table[MAX_SYM];
+    int def_count;
+} SharedLib;
+
+// Entrada da tabela de indireção: símbolo de um módulo compartilhado,
+// ligado pelo simulador no primeiro uso
+typedef struct {
+    char symbol[50];
+    int  addend;
+    int  lib;       // índice do módulo compartilhado que define o símbolo
+} Import;
+
+// Opções da ligação
+typedef struct {
+    int relocatable;                 // -r: guarda os bits de relocação
+    int shared;                      // -s: gera um módulo compartilhado
+    SharedLib libs[MAX_SHARED];      // -l: módulos compartilhados usados
+    int lib_count;
+    const char *profile;             // -p: contagens de execução (simulador -p)
+} LinkOptions;
+
 // Estrutura que armazena todos os dados de um arquivo .obj
 typedef struct {
     Definition def_table[MAX_SYM];   // tabela de definições de símbolos
@@ -26,6 +52,7 @@ typedef struct {
 
     int reloc[MAX_CODE];             // bits de relocação para cada palavra do código
     int code_size;                   // tamanho do código
+    int has_reloc;                   // o arquivo tem a linha R (módulo com BEGIN/END)
 
     int code[MAX_CODE];              // código de máquina
 } ObjModule;
@@ -37,129 +64,190 @@ void parse_obj_file(
     ObjModule *module
 );
 
+void parse_shared_lib(const char *filename, SharedLib *lib);
+
 void link_two_modules(
     ObjModule *m1,
     ObjModule *m2,
-    const char *output_filename
+    const char *output_filename,
+    const LinkOptions *options
 );
 
-int find_symbol_in_def_table(Definition *defs, int def_count, const char *sym);
+int read_int_line(FILE *fp, int *values, const char *filename);
+void resolve_use(const Usage *u, int final_address, Definition *defs, int def_count,
+                 const LinkOptions *options, Import *imports, int *import_count,
+                 int *final_code, int *final_reloc);
+void optimize_layout(int *code, int *reloc, int *size, Definition *defs, int def_count,
+                     int module2_start, const char *profile_filename);
+int find_symbol_in_def_table(const Definition *defs, int def_count, const char *sym);
 void error_exit(const char *msg);
 
 // Função principal
+// Uso: ligador [-r] [-s] [-l modulo.sm ...] [-p perfil] [-o saida] mod1.obj [mod2.obj]
+// "-" no lugar de um módulo lê da entrada padrão; "-o -" escreve na saída
+// padrão, que também é o padrão quando o primeiro módulo vem de "-".
+// Com -r o executável guarda os bits de relocação e pode ser carregado pelo
+// simulador em qualquer endereço. Com -s a saída é um módulo compartilhado
+// (.sm), que exporta sua tabela de definições. Com -l, símbolos não
+// definidos nos módulos ligados são procurados nos módulos compartilhados
+// e vão para a tabela de indireção do executável (implica -r). Com -p o
+// código é reorganizado conforme as contagens de execução do perfil.
 int main(int argc, char *argv[])
 {
-    if(argc < 2) {
-        fprintf(stderr, "Uso: %s mod1.obj [mod2.obj]\n", argv[0]);
+    const char *inputs[2];
+    int input_count = 0;
+    const char *output_arg = NULL;
+    static LinkOptions options;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_arg = argv[++i];
+        } else if(strcmp(argv[i], "-r") == 0) {
+            options.relocatable = 1;
+        } else if(strcmp(argv[i], "-s") == 0) {
+            options.shared = 1;
+        } else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            if(options.lib_count >= MAX_SHARED) {
+                error_exit("Módulos compartilhados demais.");
+            }
+            parse_shared_lib(argv[++i], &options.libs[options.lib_count++]);
+            options.relocatable = 1;
+        } else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            options.profile = argv[++i];
+        } else if(input_count < 2 && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0)) {
+            inputs[input_count++] = argv[i];
+        } else {
+            input_count = 0;
+            break;
+        }
+    }
+    if(input_count == 0) {
+        fprintf(stderr, "Uso: %s [-r] [-s] [-l modulo.sm ...] [-p perfil] [-o saida] mod1.obj [mod2.obj]\n",
+                argv[0]);
         exit(1);
     }
+    if(input_count == 2 && strcmp(inputs[0], "-") == 0 && strcmp(inputs[1], "-") == 0) {
+        error_exit("Apenas um módulo pode vir da entrada padrão.");
+    }
+    if(options.shared && options.lib_count > 0) {
+        error_exit("Um módulo compartilhado não pode depender de outro (-s com -l).");
+    }
 
     // Processa primeiro módulo
     ObjModule module1;
     memset(&module1, 0, sizeof(ObjModule));
-    parse_obj_file(argv[1], &module1);
+    parse_obj_file(inputs[0], &module1);
 
     // Se houver segundo módulo, processa ele também
     ObjModule module2;
     memset(&module2, 0, sizeof(ObjModule));
 
-    int has_second = (argc >= 3);
+    int has_second = (input_count == 2);
     if(has_second) {
-        parse_obj_file(argv[2], &module2);
+        parse_obj_file(inputs[1], &module2);
     }
 
     // Cria nome do arquivo de saída substituindo extensão .obj por .e
-    char output_file[256];
-    strncpy(output_file, argv[1], sizeof(output_file));
-    char *dot = strrchr(output_file, '.');
-    if(dot) {
-        strcpy(dot, ".e");
+    char output_file[4096];
+    if(output_arg) {
+        snprintf(output_file, sizeof(output_file), "%s", output_arg);
+    } else if(strcmp(inputs[0], "-") == 0) {
+        strcpy(output_file, "-");
     } else {
-        strcat(output_file, ".e");
+        size_t base_length = strlen(inputs[0]);
+        const char *dot = strrchr(inputs[0], '.');
+        const char *slash = strrchr(inputs[0], '/');
+        if(dot && (!slash || dot > slash)) base_length = (size_t)(dot - inputs[0]);
+        int n = snprintf(output_file, sizeof(output_file), "%.*s%s", (int)base_length, inputs[0],
+                         options.shared ? ".sm" : ".e");
+        if(n < 0 || (size_t)n >= sizeof(output_file)) {
+            error_exit("Nome de arquivo muito longo.");
+        }
     }
 
     // Realiza a ligação dos módulos
     if(!has_second) {
         // Caso especial: apenas um módulo
-        link_two_modules(&module1, NULL, output_file);
+        link_two_modules(&module1, NULL, output_file, &options);
     } else {
-        link_two_modules(&module1, &module2, output_file);
+        link_two_modules(&module1, &module2, output_file, &options);
     }
 
-    printf("Ligação concluída. Gerado arquivo %s\n", output_file);
+    if(strcmp(output_file, "-") != 0) {
+        printf("Ligação concluída. Gerado arquivo %s\n", output_file);
+    }
     return 0;
 }
 
 // Função que processa um arquivo .obj e preenche a estrutura ObjModule
 // Formato esperado do arquivo:
 // D, SIMBOLO ENDERECO  (definições)
-// U, SIMBOLO ENDERECO  (usos)
+// U, SIMBOLO ENDERECO [+N]  (usos, com deslocamento opcional)
 // R, 0 1 0 1 0...     (bits de relocação)
 // 10 9 1 0 11...      (código de máquina)
+// As linhas R e de código são lidas número a número, sem limite de tamanho
+// de linha; "-" lê da entrada padrão.
 void parse_obj_file(const char *filename, ObjModule *module)
 {
-    FILE *fp = fopen(filename, "r");
-    if(!fp) {
-        fprintf(stderr, "Erro ao abrir arquivo %s\n", filename);
-        exit(1);
+    FILE *fp = stdin;
+    if(strcmp(filename, "-") != 0) {
+        fp = fopen(filename, "r");
+        if(!fp) {
+            fprintf(stderr, "Erro ao abrir arquivo %s\n", filename);
+            exit(1);
+        }
     }
 
-    char line[512];
-    while(fgets(line, sizeof(line), fp)) {
-        // Remove quebra de linha
-        char *nl = strchr(line, '\n');
-        if(nl) *nl = '\0';
-
-        if(strlen(line) == 0) continue;
-
-        // Processa linha de definição (D,)
-        if(strncmp(line, "D,", 2) == 0) {
-            char dummy[4], sym[50];
-            int addr;
-            if(sscanf(line, "%3[^,], %s %d", dummy, sym, &addr) == 3) {
+    int has_reloc = 0;
+    int c;
+    while((c = getc(fp)) != EOF) {
+        // Pula linhas vazias
+        if(c == '\n' || c == '\r') continue;
+
+        if(c == 'D' || c == 'U' || c == 'R') {
+            if(getc(fp) != ',') {
+                fprintf(stderr, "Erro: linha inválida em %s.\n", filename);
+                exit(1);
+            }
+        }
+
+        // Processa linha de definição (D,) ou de uso (U,)
+        if(c == 'D' || c == 'U') {
+            char line[512], sym[50];
+            int addr, addend = 0;
+            if(!fgets(line, sizeof(line), fp)) break;
+            if(sscanf(line, " %49s %d %d", sym, &addr, &addend) < 2) continue;
+
+            if(c == 'D') {
                 if(module->def_count >= MAX_SYM) {
                     error_exit("Muitas definições no arquivo.");
                 }
                 strcpy(module->def_table[module->def_count].symbol, sym);
                 module->def_table[module->def_count].address = addr;
                 module->def_count++;
-            }
-        }
-        // Processa linha de uso (U,)
-        else if(strncmp(line, "U,", 2) == 0) {
-            char dummy[4], sym[50];
-            int addr;
-            if(sscanf(line, "%3[^,], %s %d", dummy, sym, &addr) == 3) {
+            } else {
                 if(module->use_count >= MAX_SYM) {
                     error_exit("Muitas referências externas no arquivo.");
                 }
                 strcpy(module->use_table[module->use_count].symbol, sym);
                 module->use_table[module->use_count].address = addr;
+                module->use_table[module->use_count].addend = addend;
                 module->use_count++;
             }
         }
         // Processa linha de bits de relocação (R,)
-        else if(strncmp(line, "R,", 2) == 0) {
-            char *p = strchr(line, ',');
-            if(!p) continue;
-            p++;
-            char *tok = strtok(p, " \t");
-            int idx = 0;
-            while(tok) {
-                module->reloc[idx++] = atoi(tok);
-                tok = strtok(NULL, " \t");
-            }
-            module->code_size = idx;
+        else if(c == 'R') {
+            module->code_size = read_int_line(fp, module->reloc, filename);
+            has_reloc = 1;
         }
         // Processa linha de código de máquina
         else {
-            int count = 0;
-            char *tok = strtok(line, " \t");
-            while(tok) {
-                module->code[count++] = atoi(tok);
-                tok = strtok(NULL, " \t");
-            }
-            if(count != module->code_size) {
+            ungetc(c, fp);
+            int count = read_int_line(fp, module->code, filename);
+            if(!has_reloc) {
+                // Código sem tabela R (montado sem BEGIN/END): nada a relocar
+                module->code_size = count;
+            } else if(count != module->code_size) {
                 fprintf(stderr,
                     "Aviso: número de palavras de código (%d) difere de relocation size (%d) em %s.\n",
                     count, module->code_size, filename
@@ -168,6 +256,61 @@ void parse_obj_file(const char *filename, ObjModule *module)
         }
     }
 
+    module->has_reloc = has_reloc;
+    if(fp != stdin) fclose(fp);
+}
+
+// Lê os inteiros de uma linha (até o '\n') para 'values'
+// Retorna a quantidade lida
+int read_int_line(FILE *fp, int *values, const char *filename)
+{
+    int count = 0;
+    for(;;) {
+        int c = getc(fp);
+        while(c == ' ' || c == '\t' || c == '\r') c = getc(fp);
+        if(c == '\n' || c == EOF) return count;
+        ungetc(c, fp);
+
+        int value;
+        if(fscanf(fp, "%d", &value) != 1) {
+            fprintf(stderr, "Erro: valor inválido em %s.\n", filename);
+            exit(1);
+        }
+        if(count >= MAX_CODE) {
+            error_exit("Código excede o tamanho máximo.");
+        }
+        values[count++] = value;
+    }
+}
+
+// Lê a tabela de definições de um módulo compartilhado (.sm)
+// Formato: "S, TAMANHO", linhas "D, SIMBOLO ENDERECO", bits e código; só o
+// cabeçalho e as definições são lidos
+void parse_shared_lib(const char *filename, SharedLib *lib)
+{
+    FILE *fp = fopen(filename, "r");
+    if(!fp) {
+        fprintf(stderr, "Erro ao abrir arquivo %s\n", filename);
+        exit(1);
+    }
+
+    char line[512];
+    if(!fgets(line, sizeof(line), fp) || strncmp(line, "S,", 2) != 0) {
+        fprintf(stderr, "Erro: %s não é um módulo compartilhado (gere com ligador -s).\n", filename);
+        exit(1);
+    }
+
+    snprintf(lib->filename, sizeof(lib->filename), "%s", filename);
+    lib->def_count = 0;
+    while(fgets(line, sizeof(line), fp) && strncmp(line, "D,", 2) == 0) {
+        if(lib->def_count >= MAX_SYM) {
+            error_exit("Muitas definições no módulo compartilhado.");
+        }
+        Definition *def = &lib->def_table[lib->def_count];
+        if(sscanf(line + 2, " %49s %d", def->symbol, &def->address) == 2) {
+            lib->def_count++;
+        }
+    }
     fclose(fp);
 }
 
@@ -175,11 +318,19 @@ void parse_obj_file(const char *filename, ObjModule *module)
 // Se m2 for NULL, apenas processa m1
 // Passos principais:
 // 1. Combina o código dos dois módulos
-// 2. Ajusta endereços do segundo módulo
+// 2. Ajusta endereços do segundo módulo (palavras com bit de relocação 1)
 // 3. Resolve referências entre módulos
-// 4. Gera arquivo executável final
-void link_two_modules(ObjModule *m1, ObjModule *m2, const char *output_filename)
+// 4. Gera arquivo executável final (ou módulo compartilhado), com os bits
+//    de relocação quando pedido
+void link_two_modules(ObjModule *m1, ObjModule *m2, const char *output_filename, const LinkOptions *options)
 {
+    int relocatable = options->relocatable || options->shared;
+
+    // Sem a linha R não há como saber quais palavras são endereços
+    if((relocatable || options->profile) && (!m1->has_reloc || (m2 && !m2->has_reloc))) {
+        error_exit("Executável relocável e layout por perfil exigem módulos com BEGIN/END (linha R).");
+    }
+
     int final_code[MAX_CODE];
     int final_reloc[MAX_CODE];
     memset(final_code, 0, sizeof(final_code));
@@ -196,9 +347,14 @@ void link_two_modules(ObjModule *m1, ObjModule *m2, const char *output_filename)
     // Se existe segundo módulo, copia seu código
     int offset_module2 = offset;
     int total_size = m1->code_size;
+    if(m2 && m1->code_size + m2->code_size > MAX_CODE) {
+        error_exit("Código ligado excede o tamanho máximo.");
+    }
     if(m2) {
         for(int i=0; i < m2->code_size; i++) {
-            final_code[offset + i] = m2->code[i];
+            // Endereços internos do segundo módulo passam a contar do
+            // início do executável
+            final_code[offset + i] = m2->code[i] + (m2->reloc[i] ? offset_module2 : 0);
             final_reloc[offset + i] = m2->reloc[i];
         }
         offset += m2->code_size;
@@ -223,41 +379,70 @@ void link_two_modules(ObjModule *m1, ObjModule *m2, const char *output_filename)
         }
     }
 
-    // Resolve referências do primeiro módulo
+    // Resolve referências dos dois módulos
+    Import imports[MAX_SYM * 2];
+    int import_count = 0;
     for(int i=0; i < m1->use_count; i++) {
         Usage *u = &m1->use_table[i];
-        int idx = find_symbol_in_def_table(combined_defs, combined_count, u->symbol);
-        if(idx < 0) {
-            fprintf(stderr, "ERRO: Símbolo '%s' não definido em nenhum módulo.\n", u->symbol);
-            exit(1);
-        }
-        int real_address = combined_defs[idx].address;
-        final_code[u->address] = real_address;
-        final_reloc[u->address] = 0;
+        resolve_use(u, u->address, combined_defs, combined_count, options,
+                    imports, &import_count, final_code, final_reloc);
     }
-
-    // Resolve referências do segundo módulo
     if(m2) {
         for(int i=0; i < m2->use_count; i++) {
             Usage *u = &m2->use_table[i];
-            int usage_address_in_final = offset_module2 + u->address;
+            resolve_use(u, offset_module2 + u->address, combined_defs, combined_count, options,
+                        imports, &import_count, final_code, final_reloc);
+        }
+    }
 
-            int idx = find_symbol_in_def_table(combined_defs, combined_count, u->symbol);
-            if(idx < 0) {
-                fprintf(stderr, "ERRO: Símbolo '%s' não definido em nenhum módulo.\n", u->symbol);
-                exit(1);
-            }
-            int real_address = combined_defs[idx].address;
-            final_code[usage_address_in_final] = real_address;
-            final_reloc[usage_address_in_final] = 0;
+    // Reorganiza o código conforme o perfil de execução
+    if(options->profile) {
+        optimize_layout(final_code, final_reloc, &total_size, combined_defs, combined_count,
+                        offset_module2, options->profile);
+    }
+
+    // Gera arquivo executável final ("-" é a saída padrão)
+    FILE *out = stdout;
+    if(strcmp(output_filename, "-") != 0) {
+        out = fopen(output_filename, "w");
+        if(!out) {
+            perror("Erro criando arquivo de saída");
+            exit(1);
         }
     }
 
-    // Gera arquivo executável final
-    FILE *out = fopen(output_filename, "w");
-    if(!out) {
-        perror("Erro criando arquivo de saída");
-        exit(1);
+    // Executável relocável ("E,") ou módulo compartilhado ("S,"): cabeçalho
+    // com o tamanho, tabelas e os bits de relocação empacotados, 32 palavras
+    // por grupo em hexadecimal (bit k do grupo g corresponde à palavra 32g+k)
+    if(relocatable) {
+        fprintf(out, "%c, %d\n", options->shared ? 'S' : 'E', total_size);
+
+        // Módulo compartilhado: exporta todas as definições
+        if(options->shared) {
+            for(int i=0; i < combined_count; i++) {
+                fprintf(out, "D, %s %d\n", combined_defs[i].symbol, combined_defs[i].address);
+            }
+        }
+
+        // Módulos compartilhados usados e tabela de indireção
+        if(import_count > 0) {
+            for(int i=0; i < options->lib_count; i++) {
+                fprintf(out, "N, %s\n", options->libs[i].filename);
+            }
+            for(int i=0; i < import_count; i++) {
+                fprintf(out, "I, %s %d %d\n", imports[i].symbol, imports[i].addend, imports[i].lib);
+            }
+        }
+
+        fprintf(out, "R,");
+        for(int g=0; g < (total_size + 31) / 32; g++) {
+            unsigned bits = 0;
+            for(int k=0; k < 32 && g * 32 + k < total_size; k++) {
+                if(final_reloc[g * 32 + k]) bits |= 1u << k;
+            }
+            fprintf(out, " %08X", bits);
+        }
+        fprintf(out, "\n");
     }
 
     for(int i=0; i < total_size; i++) {
@@ -265,12 +450,312 @@ void link_two_modules(ObjModule *m1, ObjModule *m2, const char *output_filename)
     }
     fprintf(out, "\n");
 
-    fclose(out);
+    if(out != stdout) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+}
+
+// Resolve um uso na posição 'final_address' do executável. Símbolos dos
+// módulos ligados viram endereços relocáveis; os dos módulos compartilhados
+// (-l) viram uma entrada da tabela de indireção, e a palavra recebe
+// -(índice + 1) com bit de relocação 0 -- o simulador troca o valor pelo
+// endereço na primeira vez que a instrução é executada
+void resolve_use(const Usage *u, int final_address, Definition *defs, int def_count,
+                 const LinkOptions *options, Import *imports, int *import_count,
+                 int *final_code, int *final_reloc)
+{
+    int idx = find_symbol_in_def_table(defs, def_count, u->symbol);
+    if(idx >= 0) {
+        // O endereço resolvido continua relativo ao início do executável
+        final_code[final_address] = defs[idx].address + u->addend;
+        final_reloc[final_address] = 1;
+        return;
+    }
+
+    for(int lib=0; lib < options->lib_count; lib++) {
+        const SharedLib *sl = &options->libs[lib];
+        if(find_symbol_in_def_table(sl->def_table, sl->def_count, u->symbol) < 0) continue;
+
+        // Reaproveita a entrada de um uso anterior do mesmo símbolo+deslocamento
+        int entry = 0;
+        while(entry < *import_count &&
+              (strcasecmp(imports[entry].symbol, u->symbol) != 0 || imports[entry].addend != u->addend)) {
+            entry++;
+        }
+        if(entry == *import_count) {
+            if(*import_count >= MAX_SYM * 2) {
+                error_exit("Tabela de indireção cheia.");
+            }
+            strcpy(imports[entry].symbol, u->symbol);
+            imports[entry].addend = u->addend;
+            imports[entry].lib = lib;
+            (*import_count)++;
+        }
+        final_code[final_address] = -(entry + 1);
+        final_reloc[final_address] = 0;
+        return;
+    }
+
+    fprintf(stderr, "ERRO: Símbolo '%s' não definido em nenhum módulo.\n", u->symbol);
+    exit(1);
+}
+
+// Tamanho em palavras da instrução com o opcode dado (0 se inválido)
+static int instruction_size(int opcode)
+{
+    if(opcode < 1 || opcode > 14) return 0;
+    if(opcode == 9) return 3;   // COPY
+    if(opcode == 14) return 1;  // STOP
+    return 2;
+}
+
+// Bloco básico do código ligado
+typedef struct {
+    int start, end;        // Palavras [start, end)
+    int last;              // Endereço da última instrução
+    int next;              // Bloco seguinte da cadeia (fluxo contínuo) ou -1
+    int chain;             // Índice da cadeia que contém o bloco
+    unsigned long count;   // Execuções da primeira instrução
+} Block;
+
+// Layout guiado por perfil. O perfil tem uma linha "ENDERECO CONTAGEM" por
+// instrução executada (simulador -p, com o executável no layout original).
+//  1. Percorre o código a partir do endereço 0 seguindo os saltos e marca
+//     as instruções alcançáveis e os líderes de bloco básico.
+//  2. Blocos ligados por fluxo contínuo (sem JMP/STOP no fim) formam
+//     cadeias, que não podem ser separadas.
+//  3. A cadeia de entrada vai primeiro. Se uma cadeia termina em JMP para o
+//     início de outra cadeia e o JMP foi executado, essa cadeia é colocada
+//     logo depois e o JMP é removido; senão segue a cadeia não colocada
+//     mais executada. Cadeias frias e palavras que não são código (dados)
+//     ficam no fim, na ordem original.
+//  4. Toda palavra com bit de relocação 1 é um endereço interno e é
+//     traduzida para o novo layout, assim como as definições.
+// Saltos com destino absoluto (bit 0) impedem mover o código; nesse caso o
+// layout original é mantido. O relatório vai para stderr.
+void optimize_layout(int *code, int *reloc, int *size, Definition *defs, int def_count,
+                     int module2_start, const char *profile_filename)
+{
+    int n = *size;
+    static unsigned long counts[MAX_CODE];
+    static int is_inst[MAX_CODE], leader[MAX_CODE], block_of[MAX_CODE], map[MAX_CODE];
+    static int worklist[MAX_CODE], placed_chain[MAX_CODE], dropped[MAX_CODE];
+    static Block blocks[MAX_CODE];
+    static int chain_head[MAX_CODE], chain_order[MAX_CODE];
+    static unsigned long chain_weight[MAX_CODE];
+    int new_code[MAX_CODE], new_reloc[MAX_CODE];
+    memset(counts, 0, sizeof(counts));
+    memset(is_inst, 0, sizeof(is_inst));
+    memset(leader, 0, sizeof(leader));
+    memset(dropped, 0, sizeof(dropped));
+
+    // Lê o perfil
+    FILE *fp = fopen(profile_filename, "r");
+    if(!fp) {
+        fprintf(stderr, "Erro ao abrir arquivo %s\n", profile_filename);
+        exit(1);
+    }
+    int addr;
+    unsigned long count;
+    while(fscanf(fp, "%d %lu", &addr, &count) == 2) {
+        if(addr < 0 || addr >= n) {
+            fprintf(stderr, "Erro: endereço %d do perfil fora do código ligado (%d palavras).\n", addr, n);
+            exit(1);
+        }
+        counts[addr] = count;
+    }
+    fclose(fp);
+
+    // 1. Instruções alcançáveis a partir da entrada
+    int top = 0;
+    worklist[top++] = 0;
+    leader[0] = 1;
+    while(top > 0) {
+        int a = worklist[--top];
+        while(a < n && !is_inst[a]) {
+            int op = code[a];
+            int len = instruction_size(op);
+            if(len == 0 || a + len > n) break;
+            is_inst[a] = 1;
+
+            if(op >= 5 && op <= 8) {
+                int target = code[a + 1];
+                if(!reloc[a + 1] && target >= 0) {
+                    fprintf(stderr, "Aviso: salto absoluto em %d; layout original mantido.\n", a);
+                    return;
+                }
+                if(reloc[a + 1] && target >= 0 && target < n && !is_inst[target]) {
+                    worklist[top++] = target;
+                }
+                if(reloc[a + 1] && target >= 0 && target < n) leader[target] = 1;
+                if(a + len < n) leader[a + len] = 1;
+            }
+            if(op == 5 || op == 14) break;
+            a += len;
+        }
+    }
+
+    // Blocos básicos, em ordem de endereço
+    int block_count = 0;
+    for(int a = 0; a < n; ) {
+        if(!is_inst[a]) {
+            block_of[a] = -1;
+            a++;
+            continue;
+        }
+        Block *b = &blocks[block_count];
+        b->start = a;
+        b->count = counts[a];
+        b->next = -1;
+        int ends_flow = 0;  // 1 = salto condicional, 2 = JMP ou STOP
+        do {
+            int op = code[a];
+            for(int k = 0; k < instruction_size(op); k++) block_of[a + k] = block_count;
+            b->last = a;
+            a += instruction_size(op);
+            if(op >= 6 && op <= 8) ends_flow = 1;
+            if(op == 5 || op == 14) ends_flow = 2;
+        } while(!ends_flow && a < n && is_inst[a] && !leader[a]);
+        b->end = a;
+
+        // Fluxo contínuo: o próximo bloco precisa vir logo depois
+        if(ends_flow != 2) {
+            if(a >= n || !is_inst[a]) {
+                fprintf(stderr, "Aviso: o código em %d continua em palavras que não são instruções; "
+                                "layout original mantido.\n", b->last);
+                return;
+            }
+            b->next = block_count + 1;
+        }
+        block_count++;
+    }
+
+    // 2. Cadeias: sequências de blocos ligados por fluxo contínuo
+    int chain_count = 0;
+    for(int i = 0; i < block_count; i++) {
+        if(i == 0 || blocks[i - 1].next != i) {
+            chain_head[chain_count] = i;
+            chain_weight[chain_count] = 0;
+            placed_chain[chain_count] = 0;
+            chain_count++;
+        }
+        blocks[i].chain = chain_count - 1;
+        if(blocks[i].count > chain_weight[chain_count - 1]) chain_weight[chain_count - 1] = blocks[i].count;
+    }
+
+    // 3. Ordem das cadeias
+    int order_count = 0;
+    int current = 0;
+    unsigned long saved = 0;
+    int jumps_removed = 0;
+    while(order_count < chain_count) {
+        if(current < 0) {
+            // Próxima cadeia: a mais executada ainda não colocada
+            for(int c = 0; c < chain_count; c++) {
+                if(!placed_chain[c] && (current < 0 || chain_weight[c] > chain_weight[current])) current = c;
+            }
+        }
+        placed_chain[current] = 1;
+        chain_order[order_count++] = current;
+
+        // Último bloco da cadeia: um JMP executado para o início de outra
+        // cadeia ainda livre é trocado pelo fluxo contínuo
+        int last_block = chain_head[current];
+        while(blocks[last_block].next >= 0) last_block = blocks[last_block].next;
+        int jmp = blocks[last_block].last;
+        int next = -1;
+        if(code[jmp] == 5 && reloc[jmp + 1] && counts[jmp] > 0) {
+            int target = code[jmp + 1];
+            if(target >= 0 && target < n && block_of[target] >= 0) {
+                int tb = block_of[target];
+                int tc = blocks[tb].chain;
+                if(blocks[tb].start == target && chain_head[tc] == tb && !placed_chain[tc]) {
+                    dropped[jmp] = 1;
+                    saved += counts[jmp];
+                    jumps_removed++;
+                    next = tc;
+                }
+            }
+        }
+        current = next;
+    }
+
+    // Novos endereços: código na ordem das cadeias, depois o resto. As
+    // palavras de um JMP removido passam a apontar para o início da cadeia
+    // seguinte, que ocupa o lugar dele
+    int out = 0;
+    for(int i = 0; i < n; i++) map[i] = -1;
+    for(int k = 0; k < chain_count; k++) {
+        for(int b = chain_head[chain_order[k]]; b >= 0; b = blocks[b].next) {
+            int last = blocks[b].last;
+            for(int a = blocks[b].start; a < blocks[b].end; a++) {
+                if(dropped[last] && a >= last) {
+                    map[a] = out;
+                    continue;
+                }
+                map[a] = out;
+                new_code[out] = code[a];
+                new_reloc[out] = reloc[a];
+                out++;
+            }
+        }
+    }
+    int code_words = out;
+    for(int a = 0; a < n; a++) {
+        if(map[a] == -1) {
+            map[a] = out;
+            new_code[out] = code[a];
+            new_reloc[out] = reloc[a];
+            out++;
+        }
+    }
+
+    // 4. Traduz os endereços internos
+    for(int i = 0; i < out; i++) {
+        if(new_reloc[i] && new_code[i] >= 0 && new_code[i] < n) {
+            new_code[i] = map[new_code[i]];
+        }
+    }
+    for(int i = 0; i < def_count; i++) {
+        if(defs[i].address >= 0 && defs[i].address < n) defs[i].address = map[defs[i].address];
+    }
+
+    // Relatório
+    unsigned long executed = 0, module_counts[2] = { 0, 0 };
+    int executed_blocks = 0;
+    for(int a = 0; a < n; a++) {
+        executed += counts[a];
+        module_counts[a >= module2_start] += counts[a];
+    }
+    for(int i = 0; i < block_count; i++) executed_blocks += (blocks[i].count > 0);
+
+    fprintf(stderr, "Layout guiado por perfil (%s):\n", profile_filename);
+    fprintf(stderr, "  instruções executadas por módulo: 1 = %lu, 2 = %lu\n", module_counts[0], module_counts[1]);
+    fprintf(stderr, "  blocos básicos: %d (%d executados), cadeias: %d\n", block_count, executed_blocks, chain_count);
+    fprintf(stderr, "  ordem das cadeias (endereços originais):");
+    for(int k = 0; k < chain_count; k++) {
+        int c = chain_order[k];
+        int last_block = chain_head[c];
+        while(blocks[last_block].next >= 0) last_block = blocks[last_block].next;
+        fprintf(stderr, " [%d-%d]x%lu", blocks[chain_head[c]].start, blocks[last_block].end - 1, chain_weight[c]);
+    }
+    fprintf(stderr, "\n  saltos removidos: %d, palavras de código: %d -> %d\n",
+            jumps_removed, code_words + 2 * jumps_removed, code_words);
+    if(executed > 0) {
+        fprintf(stderr, "  instruções executadas (perfil): %lu -> %lu (-%.1f%%)\n",
+                executed, executed - saved, 100.0 * saved / executed);
+    }
+
+    memcpy(code, new_code, sizeof(int) * out);
+    memcpy(reloc, new_reloc, sizeof(int) * out);
+    *size = out;
 }
 
 // Busca um símbolo na tabela de definições
 // Retorna o índice se encontrar ou -1 caso contrário
-int find_symbol_in_def_table(Definition *defs, int def_count, const char *sym)
+int find_symbol_in_def_table(const Definition *defs, int def_count, const char *sym)
 {
     for(int i=0; i < def_count; i++) {
         if(strcasecmp(defs[i].symbol, sym) == 0) {
@@ -5,46 +5,134 @@
 #include "montador.h"
 
 
+static void usage(const char *program)
+{
+    fprintf(stderr, "Uso: %s [-j threads] [-E|-c] [-o saida] <arquivo.asm|arquivo.pre|->\n", program);
+    fprintf(stderr, "     %s --analyze [--costs tabela] [-o saida] <arquivo.pre|->\n", program);
+    fprintf(stderr, "     %s -w [-o saida] <arquivo.pre>\n", program);
+    exit(1);
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 2) {
-        fprintf(stderr, "Uso: %s <arquivo.asm|arquivo.pre>\n", argv[0]);
-        exit(1);
-    }
+    int threads = 1;                 // -j N: preprocess with N threads (0 = one per processor)
+    int mode = 0;                    // 'E' = preprocess only, 'c' = assemble only, 0 = by extension
+    const char *output_arg = NULL;   // -o: output file ("-" = stdout)
+    const char *input_file = NULL;   // "-" = stdin
+    int analyze = 0;                 // --analyze: report the control-flow graph instead of assembling
+    const char *cost_file = NULL;    // --costs: cost table for --analyze
+    int watch = 0;                   // -w: reassemble incrementally whenever the input changes
 
-    // Detect extension
-    char *input_file = argv[1];
-    char *dot = strrchr(input_file, '.');
-    if (!dot) {
-        fprintf(stderr, "Erro: arquivo sem extensão.\n");
-        exit(1);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_arg = argv[++i];
+        } else if (strcmp(argv[i], "-w") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--analyze") == 0) {
+            analyze = 1;
+        } else if (strcmp(argv[i], "--costs") == 0 && i + 1 < argc) {
+            cost_file = argv[++i];
+        } else if (strcmp(argv[i], "-E") == 0 || strcmp(argv[i], "-c") == 0) {
+            if (mode && mode != argv[i][1]) {
+                fprintf(stderr, "Erro: -E e -c não podem ser usados juntos.\n");
+                exit(1);
+            }
+            mode = argv[i][1];
+        } else if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            usage(argv[0]);
+        } else if (!input_file) {
+            input_file = argv[i];
+        } else {
+            usage(argv[0]);
+        }
     }
+    if (!input_file) usage(argv[0]);
+    if (cost_file && !analyze) usage(argv[0]);
+    if (watch && (analyze || mode == 'E')) usage(argv[0]);
 
-    // Build output filename
-    char output_file[256];
-    strcpy(output_file, input_file);
+    int from_stdin = (strcmp(input_file, "-") == 0);
 
-    if (strcasecmp(dot, ".asm") == 0) {
-        // Replace .asm with .pre
-        strcpy(strrchr(output_file, '.'), ".pre");
+    // The analysis works on the assembled code, so the input is a .pre file
+    if (analyze) {
+        char *dot = strrchr(input_file, '.');
+        if (mode == 'E' || (!from_stdin && (!dot || strcasecmp(dot, ".pre") != 0))) {
+            fprintf(stderr, "Erro: --analyze recebe um arquivo pré-processado (.pre).\n");
+            exit(1);
+        }
+        analisar_programa(input_file, output_arg ? output_arg : "-", cost_file);
+        return 0;
+    }
 
-        // Call your preprocessor
-        preprocess_file(input_file, output_file);
-        printf("Preprocessamento concluído. Arquivo gerado: %s\n", output_file);
+    // The watched .pre is reread on every change, so it must be a file
+    if (watch) {
+        char *dot = strrchr(input_file, '.');
+        if (from_stdin || !dot || strcasecmp(dot, ".pre") != 0) {
+            fprintf(stderr, "Erro: -w recebe um arquivo pré-processado (.pre).\n");
+            exit(1);
+        }
+        if (output_arg && strcmp(output_arg, "-") == 0) {
+            fprintf(stderr, "Erro: -w grava a saída em arquivo.\n");
+            exit(1);
+        }
+        mode = 'c';
     }
-    else if (strcasecmp(dot, ".pre") == 0) {
-        // Replace .pre with .obj
-        strcpy(strrchr(output_file, '.'), ".obj");
 
-        // Call assembler
-        montar_programa(input_file, output_file);
-        printf("Montagem concluída. Saída: %s\n", output_file);
+    // Without -E/-c, the stage is chosen by the input extension
+    if (!mode) {
+        char *dot = strrchr(input_file, '.');
+        if (from_stdin) {
+            fprintf(stderr, "Erro: com entrada padrão, use -E (pré-processar) ou -c (montar).\n");
+            exit(1);
+        }
+        if (!dot) {
+            fprintf(stderr, "Erro: arquivo sem extensão.\n");
+            exit(1);
+        }
+        if (strcasecmp(dot, ".asm") == 0) {
+            mode = 'E';
+        } else if (strcasecmp(dot, ".pre") == 0) {
+            mode = 'c';
+        } else {
+            fprintf(stderr, "Extensão não reconhecida ('%s'). Use .asm ou .pre.\n", dot);
+            exit(1);
+        }
+    }
+
+    // Build output filename: -o, stdout for stdin, or the input with .pre/.obj
+    char output_file[4096];
+    if (output_arg) {
+        snprintf(output_file, sizeof(output_file), "%s", output_arg);
+    } else if (from_stdin) {
+        strcpy(output_file, "-");
+    } else {
+        size_t base_length = strlen(input_file);
+        char *dot = strrchr(input_file, '.');
+        char *slash = strrchr(input_file, '/');
+        if (dot && (!slash || dot > slash)) base_length = (size_t)(dot - input_file);
+        int n = snprintf(output_file, sizeof(output_file), "%.*s%s", (int)base_length, input_file,
+                         mode == 'E' ? ".pre" : ".obj");
+        if (n < 0 || (size_t)n >= sizeof(output_file)) {
+            fprintf(stderr, "Erro: nome de arquivo muito longo.\n");
+            exit(1);
+        }
+    }
+    int to_stdout = (strcmp(output_file, "-") == 0);
 
+    if (mode == 'E') {
+        // Call your preprocessor
+        preprocess_file_parallel(input_file, output_file, threads);
+        if (!to_stdout) printf("Preprocessamento concluído. Arquivo gerado: %s\n", output_file);
+    }
+    else if (watch) {
+        observar_programa(input_file, output_file);
     }
     else {
-        fprintf(stderr, "Extensão não reconhecida ('%s'). Use .asm ou .pre.\n", dot);
-        exit(1);
+        // Call assembler
+        montar_programa(input_file, output_file);
+        if (!to_stdout) printf("Montagem concluída. Saída: %s\n", output_file);
     }
 
     return 0;
-}
\ No newline at end of file
+}
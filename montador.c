@@ -2,6 +2,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <setjmp.h>
+#include <sys/stat.h>
+#include "montador.h"
 
 // Constantes para limites do programa
 #define MAX_LABELS     100        // Número máximo de rótulos permitidos
@@ -28,15 +33,10 @@ char *strcasestr(const char *haystack, const char *needle) {
     return NULL;
 }
 
-// Tabela de instruções do assembly inventado
+// Tabela de instruções do assembly inventado (OpCode em montador.h)
 // Cada instrução tem um mnemônico, código de operação e tamanho em palavras
-typedef struct {
-    char mnemonico[10];  // Nome da instrução (ex: ADD, SUB)
-    int  opcode;         // Código numérico da operação
-    int  tamanho;        // Quantidade de palavras que a instrução ocupa
-} OpCode;
-
 // Lista de todas as instruções suportadas com seus respectivos códigos e tamanhos
+// A posição de cada instrução é opcode - 1, o que permite indexar por Keyword
 const OpCode opcodes[] = {
     {"ADD", 1, 2}, {"SUB", 2, 2}, {"MULT", 3, 2}, {"DIV", 4, 2},
     {"JMP", 5, 2}, {"JMPN", 6, 2}, {"JMPP", 7, 2}, {"JMPZ", 8, 2},
@@ -56,6 +56,7 @@ typedef struct {
 // Estrutura para referências ainda não resolvidas
 typedef struct {
     char label[50];               // Nome do rótulo
+    int  addend;                  // Deslocamento somado ao endereço (ROTULO+N)
     int  instruction_address;     // Endereço da instrução que usa o rótulo
 } PendingReference;
 
@@ -68,35 +69,108 @@ typedef struct {
     int             pending_count;          // Quantidade de referências pendentes
 } SymbolTable;
 
+// Resultado da leitura de um programa: código, relocação e símbolos
+typedef struct {
+    int code[MAX_CODE_SIZE];                  // Código objeto
+    int reloc[MAX_CODE_SIZE];                 // Bits de relocação
+    unsigned char is_instruction[MAX_CODE_SIZE]; // 1 na primeira palavra de cada instrução
+    int code_size;                            // Palavras geradas
+    int has_begin_end;                        // Módulo (BEGIN/END) ou programa simples
+    SymbolTable sym;                          // Tabela de símbolos, já resolvida
+} Assembly;
+
 // Declarações antecipadas das funções principais
 int  find_opcode(const char *mnemonico, int *size);
+int  line_words(int section, Keyword kw);
 int  is_valid_label(const char *lbl);
 void trim_newline(char *str);
+void assembly_error(void) __attribute__((noreturn));
 
 void add_label(SymbolTable *sym, const char* name, int address,
                int is_extern, int is_public, int is_defined);
-void add_pending(SymbolTable *sym, const char *label, int instr_address);
+void add_pending(SymbolTable *sym, const char *label, int addend, int instr_address);
+int  parse_number(const char *str, int *value);
+void compact_operands(char *operands);
+char *read_operands(void);
+int  parse_operand(const char *operand, int *number, char *label, int *addend);
+void add_operand(SymbolTable *sym, const char *operand, int *code, int instr_address);
 int  get_label_address(SymbolTable *sym, const char* label);
 void fix_pending(SymbolTable *sym, int *code, int code_size, int *reloc);
 
+void print_module_tables(SymbolTable *sym, FILE *out);
 void print_module_output(SymbolTable *sym, int *code, int code_size, int *reloc, FILE *out);
 void print_flat_output(int *code, int code_size, FILE *out);
+void assemble_stream(FILE *fp, Assembly *as);
+FILE *open_assembler_input(const char *input_filename);
+FILE *open_assembler_output(const char *output_filename);
+void close_assembler_output(FILE *out);
 
 // Função principal do montador
 void montar_programa(const char *input_filename, const char *output_filename);
 
+// Empacota até 7 caracteres maiúsculos num inteiro, um por byte
+#define PACK(a, b, c, d, e, f, g) \
+    ((uint64_t)(a) | (uint64_t)(b) << 8 | (uint64_t)(c) << 16 | (uint64_t)(d) << 24 | \
+     (uint64_t)(e) << 32 | (uint64_t)(f) << 40 | (uint64_t)(g) << 48)
+
+// Classifica um token como instrução, diretiva ou KW_NONE.
+// O token (até 7 caracteres, sem diferenciar maiúsculas) é empacotado num
+// inteiro de 64 bits e um único switch sobre esse valor escolhe a palavra-
+// chave -- não há percurso da tabela nem strcasecmp.
+Keyword classify_token(const char *token)
+{
+    uint64_t key = 0;
+    int i;
+    for(i = 0; token[i] != '\0'; i++) {
+        if(i == 7) return KW_NONE; // Nenhuma palavra-chave tem mais de 7 letras
+        unsigned char c = (unsigned char)token[i];
+        if(c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        key |= (uint64_t)c << (8 * i);
+    }
+
+    switch(key) {
+        case PACK('A','D','D',0,0,0,0):         return KW_ADD;
+        case PACK('S','U','B',0,0,0,0):         return KW_SUB;
+        case PACK('M','U','L','T',0,0,0):       return KW_MULT;
+        case PACK('D','I','V',0,0,0,0):         return KW_DIV;
+        case PACK('J','M','P',0,0,0,0):         return KW_JMP;
+        case PACK('J','M','P','N',0,0,0):       return KW_JMPN;
+        case PACK('J','M','P','P',0,0,0):       return KW_JMPP;
+        case PACK('J','M','P','Z',0,0,0):       return KW_JMPZ;
+        case PACK('C','O','P','Y',0,0,0):       return KW_COPY;
+        case PACK('L','O','A','D',0,0,0):       return KW_LOAD;
+        case PACK('S','T','O','R','E',0,0):     return KW_STORE;
+        case PACK('I','N','P','U','T',0,0):     return KW_INPUT;
+        case PACK('O','U','T','P','U','T',0):   return KW_OUTPUT;
+        case PACK('S','T','O','P',0,0,0):       return KW_STOP;
+        case PACK('S','E','C','T','I','O','N'): return KW_SECTION;
+        case PACK('P','U','B','L','I','C',0):   return KW_PUBLIC;
+        case PACK('E','X','T','E','R','N',0):   return KW_EXTERN;
+        case PACK('B','E','G','I','N',0,0):     return KW_BEGIN;
+        case PACK('E','N','D',0,0,0,0):         return KW_END;
+        case PACK('S','P','A','C','E',0,0):     return KW_SPACE;
+        case PACK('C','O','N','S','T',0,0):     return KW_CONST;
+        default:                                return KW_NONE;
+    }
+}
+
 // Busca uma instrução na tabela de opcodes e retorna seu código
 // Retorna -1 se não encontrar e atualiza o tamanho da instrução
 int find_opcode(const char *mnemonico, int *size)
 {
-    int nops = (int)(sizeof(opcodes) / sizeof(opcodes[0]));
-    for(int i = 0; i < nops; i++) {
-        if(strcasecmp(opcodes[i].mnemonico, mnemonico) == 0) {
-            *size = opcodes[i].tamanho;
-            return opcodes[i].opcode;
-        }
-    }
-    return -1;
+    Keyword kw = classify_token(mnemonico);
+    if(kw == KW_NONE || kw > KW_LAST_INSTRUCTION) return -1;
+    *size = opcodes[kw - 1].tamanho;
+    return opcodes[kw - 1].opcode;
+}
+
+// Palavras geradas por uma linha na seção dada: o tamanho da instrução na
+// seção TEXT e 1 para SPACE e CONST (e para linhas inválidas, cujo erro é
+// dado depois)
+int line_words(int section, Keyword kw)
+{
+    if(section == 1 && kw != KW_NONE && kw <= KW_LAST_INSTRUCTION) return opcodes[kw - 1].tamanho;
+    return 1;
 }
 
 // Verifica se um rótulo é válido sintaticamente:
@@ -123,6 +197,19 @@ void trim_newline(char *str)
     }
 }
 
+// Retorno de um erro de montagem durante uma atualização da sessão do
+// observador (NULL fora dela)
+static jmp_buf *assembly_error_return = NULL;
+
+// Encerra a montagem depois de um erro já informado em stderr. Na
+// atualização da sessão volta para tentar_atualizar_sessao, que desfaz as
+// linhas alteradas; fora dela termina o programa.
+void assembly_error(void)
+{
+    if(assembly_error_return) longjmp(*assembly_error_return, 1);
+    exit(1);
+}
+
 // Adiciona ou atualiza um rótulo na tabela de símbolos
 // Gera erro se tentar redefinir um rótulo já definido
 void add_label(SymbolTable *sym, const char* name, int address,
@@ -130,7 +217,7 @@ void add_label(SymbolTable *sym, const char* name, int address,
 {
     if (!is_valid_label(name)) {
         fprintf(stderr, "ERRO: Rótulo inválido '%s'.\n", name);
-        exit(1);
+        assembly_error();
     }
 
     // Procura se o rótulo já existe
@@ -138,7 +225,7 @@ void add_label(SymbolTable *sym, const char* name, int address,
         if(strcasecmp(sym->labels[i].name, name) == 0) {
             if(is_defined && sym->labels[i].is_defined) {
                 fprintf(stderr, "ERRO: Rótulo '%s' redefinido.\n", name);
-                exit(1);
+                assembly_error();
             }
             // Atualiza as informações do rótulo existente
             if(is_defined) {
@@ -159,7 +246,7 @@ void add_label(SymbolTable *sym, const char* name, int address,
     // Se não encontrou, adiciona novo rótulo
     if(sym->label_count >= MAX_LABELS) {
         fprintf(stderr, "ERRO: Excedido número máximo de rótulos.\n");
-        exit(1);
+        assembly_error();
     }
 
     strcpy(sym->labels[sym->label_count].name, name);
@@ -171,17 +258,125 @@ void add_label(SymbolTable *sym, const char* name, int address,
 }
 
 // Adiciona uma referência pendente para ser resolvida depois
-void add_pending(SymbolTable *sym, const char *label, int instr_address)
+void add_pending(SymbolTable *sym, const char *label, int addend, int instr_address)
 {
     if(sym->pending_count >= MAX_LABELS) {
         fprintf(stderr, "ERRO: Excedido número máximo de pendências.\n");
         exit(1);
     }
     strcpy(sym->pendings[sym->pending_count].label, label);
+    sym->pendings[sym->pending_count].addend = addend;
     sym->pendings[sym->pending_count].instruction_address = instr_address;
     sym->pending_count++;
 }
 
+// Converte um número decimal ou hexadecimal (0x) em valor
+// Retorna 0 se a string não for um número
+int parse_number(const char *str, int *value)
+{
+    const char *digits = (*str == '-' || *str == '+') ? str + 1 : str;
+    if(!isdigit((unsigned char)*digits)) return 0;
+
+    char *end;
+    if(strncasecmp(digits, "0x", 2) == 0) {
+        *value = (int)strtol(str, &end, 16);
+    } else {
+        *value = (int)strtol(str, &end, 10);
+    }
+    return *end == '\0';
+}
+
+// Tira os espaços em volta de '+', '-' e ',' e nas pontas, de modo que
+// "VET + 3" e "VET+3" sejam equivalentes. Qualquer outro espaço separa um
+// token a mais ("LOAD X Y"), que é erro.
+void compact_operands(char *operands)
+{
+    char *write = operands;
+    for(char *read = operands; *read; ) {
+        if(!isspace((unsigned char)*read)) {
+            *write++ = *read++;
+            continue;
+        }
+        while(isspace((unsigned char)*read)) read++;
+        char before = (write > operands) ? write[-1] : '\0';
+        if(before != '\0' && *read != '\0' && !strchr("+-,", before) && !strchr("+-,", *read)) {
+            fprintf(stderr, "ERRO: Token a mais nos operandos: '%s'.\n", read);
+            assembly_error();
+        }
+    }
+    *write = '\0';
+}
+
+// Retorna o restante da linha (os operandos) compactado por
+// compact_operands; NULL se não houver operandos
+char *read_operands(void)
+{
+    char *rest = strtok(NULL, "");
+    if(!rest) return NULL;
+    compact_operands(rest);
+    return (*rest != '\0') ? rest : NULL;
+}
+
+// Separa um operando: devolve 1 para um número (em *number) e 0 para
+// "ROTULO", "ROTULO+N" ou "ROTULO-N" (vários termos são somados e N pode
+// ter sinal), com o rótulo em 'label' (50 caracteres) e a soma dos termos
+// em *addend
+int parse_operand(const char *operand, int *number, char *label, int *addend)
+{
+    if(parse_number(operand, number)) return 1;
+
+    // Separa o rótulo do deslocamento
+    size_t len = strcspn(operand, "+-");
+    if(len == 0 || len >= 50) {
+        fprintf(stderr, "ERRO: Operando inválido '%s'.\n", operand);
+        assembly_error();
+    }
+    memcpy(label, operand, len);
+    label[len] = '\0';
+
+    *addend = 0;
+    const char *p = operand + len;
+    while(*p) {
+        int negative = (*p == '-');
+        p++;
+        // O termo pode ter sinal próprio: "VET+N" com N: EQU -1 vira "VET+-1"
+        if(*p == '+' || *p == '-') {
+            if(*p == '-') negative = !negative;
+            p++;
+        }
+        if(!isdigit((unsigned char)*p)) {
+            fprintf(stderr, "ERRO: Operando inválido '%s'.\n", operand);
+            assembly_error();
+        }
+        char *end;
+        int base = (strncasecmp(p, "0x", 2) == 0) ? 16 : 10;
+        int value = (int)strtol(p, &end, base);
+        *addend += negative ? -value : value;
+        p = end;
+        if(*p != '\0' && *p != '+' && *p != '-') {
+            fprintf(stderr, "ERRO: Operando inválido '%s'.\n", operand);
+            assembly_error();
+        }
+    }
+    return 0;
+}
+
+// Grava um operando no código: números (endereços absolutos, como os
+// gerados pela substituição de EQU) entram direto, sem relocação;
+// rótulos viram referências pendentes. O deslocamento de "ROTULO+N" é
+// somado ao endereço do rótulo em fix_pending ou, para EXTERN, pelo ligador.
+void add_operand(SymbolTable *sym, const char *operand, int *code, int instr_address)
+{
+    int number, addend;
+    char label[50];
+    if(parse_operand(operand, &number, label, &addend)) {
+        code[instr_address] = number;
+        return;
+    }
+    code[instr_address] = 0;
+    add_pending(sym, label, addend, instr_address);
+}
+
 // Busca o endereço de um rótulo na tabela de símbolos
 // Retorna -1 se não encontrar
 int get_label_address(SymbolTable *sym, const char* label)
@@ -215,19 +410,20 @@ void fix_pending(SymbolTable *sym, int *code, int code_size, int *reloc)
             }
         }
 
-        // Referências externas têm endereço 0 e bit de relocação 1
+        // Referências externas têm endereço 0 e bit de relocação 1; o
+        // deslocamento vai na tabela de uso e é somado pelo ligador
         if(is_ext) {
             code[p->instruction_address] = 0;
             reloc[p->instruction_address] = 1;
         } else {
-            code[p->instruction_address] = addr;
+            code[p->instruction_address] = addr + p->addend;
             reloc[p->instruction_address] = 1;
         }
     }
 }
 
-// Gera saída no formato de módulo com tabelas de definição e uso
-void print_module_output(SymbolTable *sym, int *code, int code_size, int *reloc, FILE *out)
+// Escreve as tabelas de definições e de uso de um módulo
+void print_module_tables(SymbolTable *sym, FILE *out)
 {
     // Tabela de definições (rótulos públicos)
     for(int i = 0; i < sym->label_count; i++) {
@@ -241,13 +437,27 @@ void print_module_output(SymbolTable *sym, int *code, int code_size, int *reloc,
         for(int j = 0; j < sym->label_count; j++){
             if(strcasecmp(sym->pendings[i].label, sym->labels[j].name) == 0){
                 if(sym->labels[j].is_extern){
-                    fprintf(out, "U, %s %d\n",
-                            sym->pendings[i].label,
-                            sym->pendings[i].instruction_address);
+                    // O deslocamento (ROTULO+N) só é escrito quando existe
+                    if(sym->pendings[i].addend != 0) {
+                        fprintf(out, "U, %s %d %+d\n",
+                                sym->pendings[i].label,
+                                sym->pendings[i].instruction_address,
+                                sym->pendings[i].addend);
+                    } else {
+                        fprintf(out, "U, %s %d\n",
+                                sym->pendings[i].label,
+                                sym->pendings[i].instruction_address);
+                    }
                 }
             }
         }
     }
+}
+
+// Gera saída no formato de módulo com tabelas de definição e uso
+void print_module_output(SymbolTable *sym, int *code, int code_size, int *reloc, FILE *out)
+{
+    print_module_tables(sym, out);
 
     // Bits de relocação
     fprintf(out, "R, ");
@@ -272,27 +482,59 @@ void print_flat_output(int *code, int code_size, FILE *out)
     fprintf(out, "\n");
 }
 
-// Função Principal do Montador
-void montar_programa(const char *input_filename, const char *output_filename)
+// Abre a entrada do montador ("-" é a entrada padrão)
+FILE *open_assembler_input(const char *input_filename)
 {
+    if(strcmp(input_filename, "-") == 0) return stdin;
     FILE *fp = fopen(input_filename, "r");
     if(!fp){
         perror("Erro ao abrir arquivo de entrada");
+        assembly_error();
+    }
+    return fp;
+}
+
+// Abre a saída do montador ("-" é a saída padrão)
+FILE *open_assembler_output(const char *output_filename)
+{
+    if(strcmp(output_filename, "-") == 0) return stdout;
+    FILE *out = fopen(output_filename, "w");
+    if(!out) {
+        perror("Erro ao criar arquivo de saída");
         exit(1);
     }
+    return out;
+}
+
+void close_assembler_output(FILE *out)
+{
+    if(out != stdout) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+}
 
+// Lê e monta um programa pré-processado.
+// A montagem é feita em uma única leitura da entrada: os rótulos recebem o
+// endereço corrente ao serem definidos e todos os operandos simbólicos viram
+// referências pendentes, resolvidas por fix_pending no fim. Assim a entrada
+// pode ser um pipe e não precisa ser relida.
+void assemble_stream(FILE *fp, Assembly *as)
+{
     // Inicializa vetores do código objeto e bits de relocação
-    int code[MAX_CODE_SIZE];
-    int reloc[MAX_CODE_SIZE];
+    int *code  = as->code;
+    int *reloc = as->reloc;
     for(int i = 0; i < MAX_CODE_SIZE; i++) {
         code[i]  = 0;
         reloc[i] = 0;
+        as->is_instruction[i] = 0;
     }
 
     // Inicializa tabela de símbolos vazia
-    SymbolTable sym;
-    sym.label_count   = 0;
-    sym.pending_count = 0;
+    SymbolTable *sym = &as->sym;
+    sym->label_count   = 0;
+    sym->pending_count = 0;
 
     int code_size       = 0;  // Contador de palavras no código objeto
     int current_section = 0;  // Seção atual (1=TEXT, 2=DATA) 
@@ -300,22 +542,18 @@ void montar_programa(const char *input_filename, const char *output_filename)
 
     char line[MAX_LINE_LENGTH];
 
-    // Passagem prévia: verifica se é um módulo (tem BEGIN/END)
-    while(fgets(line, sizeof(line), fp)){
+    // Passagem única:
+    // - Coleta os rótulos e seus endereços
+    // - Gera código objeto
+    // - Registra referências a rótulos e marca bits de relocação
+    while(fgets(line, sizeof(line), fp)) {
         trim_newline(line);
+        if(strlen(line) == 0) continue;
+
+        // Verifica se é um módulo (tem BEGIN/END)
         if(strcasestr(line, "BEGIN")) {
             has_begin_end = 1;
         }
-    }
-    rewind(fp);
-
-    // Primeira Passagem: 
-    // - Coleta todos os rótulos e seus endereços
-    // - Calcula tamanho total do código
-    code_size = 0;
-    while(fgets(line, sizeof(line), fp)) {
-        trim_newline(line);
-        if(strlen(line) == 0) continue;
 
         char *tk = strtok(line, " \t");
         if(!tk) continue;
@@ -335,187 +573,117 @@ void montar_programa(const char *input_filename, const char *output_filename)
             // Verifica se é rótulo EXTERN
             char *lookahead = strtok(NULL, " \t");
             if(lookahead && strcasecmp(lookahead, "EXTERN") == 0) {
-                add_label(&sym, lbl, 0, 1, 0, 0);
+                add_label(sym, lbl, 0, 1, 0, 0);
                 continue;
             }
-            else {
-                add_label(&sym, lbl, code_size, 0, 0, 1);
-                tk = lookahead;
-                if(!tk) continue;
-            }
+            add_label(sym, lbl, code_size, 0, 0, 1);
+            tk = lookahead;
+            if(!tk) continue;
         }
 
-        if(!tk) continue;
-
-        // Processa diretivas SECTION
-        if(strcasecmp(tk, "SECTION") == 0) {
-            char *secname = strtok(NULL, " \t");
-            if(secname) {
-                if(strcasecmp(secname, "TEXT") == 0) {
-                    current_section = 1;
-                } else if(strcasecmp(secname, "DATA") == 0) {
-                    current_section = 2;
+        Keyword kw = classify_token(tk);
+        switch(kw) {
+            // Atualiza seção atual
+            case KW_SECTION: {
+                char *sec = strtok(NULL, " \t");
+                if(sec){
+                    if(strcasecmp(sec, "TEXT") == 0) {
+                        current_section = 1;
+                    } else if(strcasecmp(sec, "DATA") == 0) {
+                        current_section = 2;
+                    }
                 }
+                continue;
             }
-            continue;
-        }
-
-        // Processa diretivas PUBLIC e EXTERN
-        if(strcasecmp(tk, "PUBLIC") == 0){
-            char *lbl = strtok(NULL," \t");
-            if(!lbl) {
-                fprintf(stderr, "ERRO: Faltou nome após PUBLIC.\n");
-                exit(1);
-            }
-            add_label(&sym, lbl, 0, 0, 1, 0);
-            continue;
-        }
-        if(strcasecmp(tk, "EXTERN") == 0){
-            char *lbl = strtok(NULL, " \t");
-            if(lbl){
-                add_label(&sym, lbl, 0, 1, 0, 0);
-            }
-            continue;
-        }
-
-        // Ignora diretivas BEGIN/END nesta passagem
-        if(strcasecmp(tk, "BEGIN") == 0){
-            continue;
-        }
-        if(strcasecmp(tk, "END") == 0){
-            continue;
-        }
 
-        // Na seção TEXT: soma tamanho das instruções
-        if(current_section == 1) {
-            int size;
-            int op = find_opcode(tk, &size);
-            if(op >= 0) {
-                code_size += size;
-            }
-        }
-        // Na seção DATA: soma tamanho das diretivas
-        else if(current_section == 2) {
-            if(strcasecmp(tk, "SPACE") == 0){
-                code_size += 1;
+            // Processa diretivas PUBLIC e EXTERN
+            case KW_PUBLIC: {
+                char *lbl = strtok(NULL," \t");
+                if(!lbl) {
+                    fprintf(stderr, "ERRO: Faltou nome após PUBLIC.\n");
+                    exit(1);
+                }
+                add_label(sym, lbl, 0, 0, 1, 0);
+                continue;
             }
-            else if(strcasecmp(tk, "CONST") == 0){
-                code_size += 1;
+            case KW_EXTERN: {
+                char *lbl = strtok(NULL, " \t");
+                if(lbl){
+                    add_label(sym, lbl, 0, 1, 0, 0);
+                }
+                continue;
             }
-        }
-    }
-    rewind(fp);
-
-    // Segunda Passagem:
-    // - Gera código objeto
-    // - Resolve referências a rótulos
-    // - Marca bits de relocação
-    code_size = 0;
-    current_section = 0;
-    while(fgets(line, sizeof(line), fp)) {
-        trim_newline(line);
-        if(strlen(line) == 0) continue;
-
-        char *tk = strtok(line, " \t");
-        if(!tk) continue;
 
-        // Pula rótulos (já processados)
-        if(strchr(tk, ':')) {
-            tk = strtok(NULL, " \t");
-            if(!tk) continue;
-        }
+            // Diretivas BEGIN/END não geram código
+            case KW_BEGIN:
+            case KW_END:
+                continue;
 
-        // Atualiza seção atual
-        if(strcasecmp(tk, "SECTION") == 0) {
-            char *sec = strtok(NULL, " \t");
-            if(sec){
-                if(strcasecmp(sec, "TEXT") == 0) {
-                    current_section = 1;
-                } else if(strcasecmp(sec, "DATA") == 0) {
-                    current_section = 2;
-                }
-            }
-            continue;
+            default:
+                break;
         }
 
-        // Pula diretivas de ligação
-        if(strcasecmp(tk, "PUBLIC") == 0){
-            strtok(NULL," \t");
-            continue;
-        }
-        if(strcasecmp(tk, "EXTERN") == 0){
-            strtok(NULL," \t");
-            continue;
-        }
+        if(current_section == 0) continue;
 
-        // Pula diretivas de módulo
-        if(strcasecmp(tk, "BEGIN") == 0){
-            strtok(NULL," \t");
-            continue;
-        }
-        if(strcasecmp(tk, "END") == 0){
-            continue;
+        // Garante espaço para as palavras da linha
+        if(code_size + line_words(current_section, kw) > MAX_CODE_SIZE) {
+            fprintf(stderr, "ERRO: Código excede %d palavras.\n", MAX_CODE_SIZE);
+            exit(1);
         }
 
         // Processa instruções na seção TEXT
         if(current_section == 1) {
-            int size = 0;
-            int op = find_opcode(tk, &size);
-            if(op >= 0) {
-                // Gera código do opcode
-                code[code_size] = op;
-                reloc[code_size] = 0;
-                code_size++;
+            if(kw == KW_NONE || kw > KW_LAST_INSTRUCTION) {
+                fprintf(stderr, "ERRO: Instrução desconhecida '%s'.\n", tk);
+                exit(1);
+            }
+            int size = opcodes[kw - 1].tamanho;
 
-                // Trata operandos
-                if(strcasecmp(tk, "COPY") == 0 && size == 3) {
-                    // COPY tem sintaxe especial: COPY X,Y
-                    char *operand = strtok(NULL, " \t");
-                    if(!operand) {
-                        fprintf(stderr, "ERRO: Operandos faltando para COPY.\n");
-                        exit(1);
-                    }
-                    char *first  = strtok(operand, ",");
-                    char *second = strtok(NULL, ",");
-                    if(!first || !second) {
-                        fprintf(stderr, "ERRO: COPY requer 'SRC,DST'.\n");
-                        exit(1);
-                    }
-                    code[code_size] = 0;
-                    add_pending(&sym, first, code_size);
-                    code_size++;
+            // Gera código do opcode
+            code[code_size] = opcodes[kw - 1].opcode;
+            reloc[code_size] = 0;
+            as->is_instruction[code_size] = 1;
+            code_size++;
 
-                    code[code_size] = 0;
-                    add_pending(&sym, second, code_size);
-                    code_size++;
+            // Trata operandos
+            if(kw == KW_COPY) {
+                // COPY tem sintaxe especial: COPY X,Y
+                char *operand = read_operands();
+                if(!operand) {
+                    fprintf(stderr, "ERRO: Operandos faltando para COPY.\n");
+                    exit(1);
                 }
-                else {
-                    // Demais instruções: operandos separados por espaço
-                    for(int i = 1; i < size; i++) {
-                        char *operand = strtok(NULL, " ,\t");
-                        if(!operand) {
-                            fprintf(stderr, "ERRO: Faltam operandos para '%s'.\n", tk);
-                            exit(1);
-                        }
-                        code[code_size] = 0;
-                        add_pending(&sym, operand, code_size);
-                        code_size++;
-                    }
+                char *first  = strtok(operand, ",");
+                char *second = strtok(NULL, ",");
+                if(!first || !second) {
+                    fprintf(stderr, "ERRO: COPY requer 'SRC,DST'.\n");
+                    exit(1);
                 }
+                add_operand(sym, first, code, code_size);
+                code_size++;
+
+                add_operand(sym, second, code, code_size);
+                code_size++;
             }
-            else {
-                fprintf(stderr, "ERRO: Instrução desconhecida '%s'.\n", tk);
-                exit(1);
+            else if(size > 1) {
+                // Demais instruções: um operando (rótulo, ROTULO+N ou número)
+                char *operand = read_operands();
+                if(!operand) {
+                    fprintf(stderr, "ERRO: Faltam operandos para '%s'.\n", tk);
+                    exit(1);
+                }
+                add_operand(sym, operand, code, code_size);
+                code_size++;
             }
         }
         // Processa diretivas na seção DATA
         else if(current_section == 2) {
-            if(strcasecmp(tk, "SPACE") == 0) {
+            if(kw == KW_SPACE) {
                 code[code_size] = 0;
                 reloc[code_size] = 0;
                 code_size++;
             }
-            else if(strcasecmp(tk, "CONST") == 0) {
+            else if(kw == KW_CONST) {
                 char *val = strtok(NULL, " \t");
                 if(!val) {
                     fprintf(stderr, "ERRO: Falta valor em CONST.\n");
@@ -537,24 +705,1251 @@ void montar_programa(const char *input_filename, const char *output_filename)
             }
         }
     }
-    fclose(fp);
-
     // Resolve referências pendentes
-    fix_pending(&sym, code, code_size, reloc);
+    fix_pending(sym, code, code_size, reloc);
+
+    as->code_size     = code_size;
+    as->has_begin_end = has_begin_end;
+}
+
+// Função Principal do Montador
+// "-" como entrada ou saída é a entrada ou a saída padrão.
+void montar_programa(const char *input_filename, const char *output_filename)
+{
+    static Assembly as;
+    FILE *fp = open_assembler_input(input_filename);
+    assemble_stream(fp, &as);
+    if(fp != stdin) fclose(fp);
 
     // Gera arquivo de saída
-    FILE *out = fopen(output_filename, "w");
-    if(!out) {
-        perror("Erro ao criar arquivo de saída");
+    FILE *out = open_assembler_output(output_filename);
+
+    // Escolhe formato de saída baseado na presença de BEGIN/END
+    if(as.has_begin_end){
+        print_module_output(&as.sym, as.code, as.code_size, as.reloc, out);
+    } else {
+        print_flat_output(as.code, as.code_size, out);
+    }
+
+    close_assembler_output(out);
+}
+
+// ---------------------------------------------------------------------------
+// Sessão de montagem incremental (-w)
+//
+// A sessão guarda as linhas da entrada já separadas em tokens, o endereço e
+// as palavras geradas por cada uma e a tabela de símbolos. Numa atualização
+// só as linhas alteradas são separadas de novo: as seguintes têm o endereço
+// deslocado pela diferença de tamanho, e só as referências a rótulos cujo
+// endereço mudou são resolvidas outra vez. Se a alteração envolve SECTION
+// ou as declarações de rótulos (definição, PUBLIC, EXTERN), os endereços e
+// a tabela de símbolos são refeitos a partir dos tokens guardados, sem reler
+// as outras linhas. O código gerado é sempre o mesmo de montar_programa.
+// ---------------------------------------------------------------------------
+
+#define MAX_SOURCE_LINES 8192     // Linhas da entrada numa sessão
+
+// Declaração de rótulo feita no início de uma linha
+enum { DECL_NONE, DECL_DEFINE, DECL_EXTERN };
+
+// Referência simbólica gerada por uma linha
+typedef struct {
+    char label[50];     // Rótulo, como escrito no operando
+    int  addend;        // Deslocamento (ROTULO+N)
+    int  offset;        // Palavra da linha que recebe o endereço
+    int  symbol;        // Índice na tabela de símbolos (-1 até ser resolvida)
+} LineReference;
+
+// Linha da entrada separada em tokens e o que ela gerou
+typedef struct {
+    char text[MAX_LINE_LENGTH];     // Linha original, para comparar com a nova versão
+    char tokens[MAX_LINE_LENGTH];   // Cópia separada por strtok
+    int  has_begin;                 // Contém BEGIN (a saída é um módulo)
+    char label[50];                 // Rótulo do início da linha ("X:")
+    int  label_decl;                // DECL_DEFINE ou DECL_EXTERN ("X: EXTERN")
+    int  symbol;                    // Índice do rótulo definido na tabela de símbolos
+    const char *keyword_token;      // Instrução ou diretiva (NULL se não houver)
+    Keyword kw;
+    const char *rest;               // Restante da linha após a instrução (NULL se vazio)
+    const char *declared;           // Nome em PUBLIC/EXTERN
+    int  section;                   // SECTION: 1=TEXT, 2=DATA, 0=mantém a seção
+
+    int  section_after;             // Seção em vigor depois da linha
+    int  address;                   // Endereço da primeira palavra gerada
+    int  size;                      // Palavras geradas
+    int  emits;                     // Passa pela verificação do tamanho do código
+    int  words[3];
+    int  reloc[3];
+    int  is_instruction;
+    LineReference refs[2];
+    int  ref_count;
+    char code_text[40];             // Palavras já formatadas ("%d " cada), como na saída
+    char reloc_text[8];             // Bits de relocação formatados
+} SourceLine;
+
+struct AssemblySession {
+    SourceLine *lines[MAX_SOURCE_LINES];
+    int line_count;
+    SymbolTable sym;            // Rótulos; as pendências só são preenchidas na gravação
+    int code_size;
+    int begin_lines;            // Linhas com BEGIN
+    int ref_count;              // Referências simbólicas (pendências da montagem completa)
+    int always_rebuild;         // Rótulo definido e declarado EXTERN: endereço depende da ordem
+    char incoming[MAX_SOURCE_LINES][MAX_LINE_LENGTH]; // Linhas lidas na atualização
+
+    // Substituição em andamento, para desfazê-la se a montagem der erro
+    int undo_first;                             // Primeira linha substituída
+    SourceLine *undo_removed[MAX_SOURCE_LINES]; // Linhas antigas, liberadas só no fim
+    int undo_removed_count;
+    SourceLine *undo_added[MAX_SOURCE_LINES];   // Linhas novas já separadas em tokens
+    int undo_added_count;
+    int undo_spliced;                           // As linhas novas já estão em 'lines'
+};
+
+// Lê a entrada em linhas do mesmo modo que assemble_stream (fgets com
+// MAX_LINE_LENGTH, sem o fim de linha) e devolve quantas foram lidas
+static int read_source_lines(const char *input_filename, char (*texts)[MAX_LINE_LENGTH])
+{
+    FILE *fp = open_assembler_input(input_filename);
+    int count = 0;
+    while(fgets(texts[count], MAX_LINE_LENGTH, fp)) {
+        trim_newline(texts[count]);
+        if(++count == MAX_SOURCE_LINES) {
+            fprintf(stderr, "ERRO: Excedido número máximo de linhas (%d) na sessão.\n", MAX_SOURCE_LINES);
+            if(fp != stdin) fclose(fp);
+            assembly_error();
+        }
+    }
+    if(fp != stdin) fclose(fp);
+    return count;
+}
+
+// Separa uma linha em tokens, como no início do laço de assemble_stream
+static SourceLine *lex_line(const char *text)
+{
+    SourceLine *ln = calloc(1, sizeof(SourceLine));
+    if(!ln) {
+        fprintf(stderr, "ERRO: Memória insuficiente.\n");
         exit(1);
     }
+    strcpy(ln->text, text);
+    strcpy(ln->tokens, text);
+    ln->symbol = -1;
+    if(text[0] == '\0') return ln;
+    ln->has_begin = strcasestr(text, "BEGIN") != NULL;
 
-    // Escolhe formato de saída baseado na presença de BEGIN/END
-    if(has_begin_end){
-        print_module_output(&sym, code, code_size, reloc, out);
+    char *tk = strtok(ln->tokens, " \t");
+    if(!tk) return ln;
+
+    if(strchr(tk, ':')) {
+        char *c = strchr(tk, ':');
+        int len = (int)(c - tk);
+        if(len <= 0 || len >= (int)sizeof(ln->label)) {
+            fprintf(stderr, "ERRO: Sintaxe de rótulo inválida '%s'.\n", tk);
+            free(ln);
+            assembly_error();
+        }
+        strncpy(ln->label, tk, len);
+        ln->label[len] = '\0';
+
+        char *lookahead = strtok(NULL, " \t");
+        if(lookahead && strcasecmp(lookahead, "EXTERN") == 0) {
+            ln->label_decl = DECL_EXTERN;
+            return ln;
+        }
+        ln->label_decl = DECL_DEFINE;
+        tk = lookahead;
+        if(!tk) return ln;
+    }
+
+    ln->keyword_token = tk;
+    ln->kw = classify_token(tk);
+    if(ln->kw == KW_SECTION) {
+        char *sec = strtok(NULL, " \t");
+        if(sec && strcasecmp(sec, "TEXT") == 0) ln->section = 1;
+        else if(sec && strcasecmp(sec, "DATA") == 0) ln->section = 2;
+    } else if(ln->kw == KW_PUBLIC) {
+        ln->declared = strtok(NULL, " \t");
+        if(!ln->declared) {
+            fprintf(stderr, "ERRO: Faltou nome após PUBLIC.\n");
+            free(ln);
+            assembly_error();
+        }
+    } else if(ln->kw == KW_EXTERN) {
+        ln->declared = strtok(NULL, " \t");
+    } else {
+        ln->rest = strtok(NULL, "");
+    }
+    return ln;
+}
+
+// Busca um rótulo na tabela de símbolos; devolve o índice ou -1
+static int find_symbol(const SymbolTable *sym, const char *label)
+{
+    for(int i = 0; i < sym->label_count; i++) {
+        if(strcasecmp(sym->labels[i].name, label) == 0) return i;
+    }
+    return -1;
+}
+
+// Formata as palavras da linha como print_module_output / print_flat_output,
+// para que a gravação só copie o texto das linhas
+static void render_line(SourceLine *ln)
+{
+    int c = 0, r = 0;
+    for(int k = 0; k < ln->size; k++) {
+        c += sprintf(ln->code_text + c, "%d ", ln->words[k]);
+        r += sprintf(ln->reloc_text + r, "%d ", ln->reloc[k]);
+    }
+    ln->code_text[c] = '\0';
+    ln->reloc_text[r] = '\0';
+}
+
+// Registra um operando da linha: número direto ou referência a resolver
+static void emit_operand(SourceLine *ln, const char *operand)
+{
+    int offset = ln->size++;
+    int number;
+    ln->reloc[offset] = 0;
+    ln->words[offset] = 0;
+
+    LineReference *r = &ln->refs[ln->ref_count];
+    if(parse_operand(operand, &number, r->label, &r->addend)) {
+        ln->words[offset] = number;
+        return;
+    }
+    r->offset = offset;
+    r->symbol = -1;
+    ln->ref_count++;
+}
+
+// Registra os operandos de uma instrução (compactados, como em read_operands)
+static void emit_operands(SourceLine *ln, char *rest)
+{
+    compact_operands(rest);
+
+    if(ln->kw == KW_COPY) {
+        if(rest[0] == '\0') {
+            fprintf(stderr, "ERRO: Operandos faltando para COPY.\n");
+            assembly_error();
+        }
+        char *first  = strtok(rest, ",");
+        char *second = strtok(NULL, ",");
+        if(!first || !second) {
+            fprintf(stderr, "ERRO: COPY requer 'SRC,DST'.\n");
+            assembly_error();
+        }
+        emit_operand(ln, first);
+        emit_operand(ln, second);
     } else {
-        print_flat_output(code, code_size, out);
+        if(rest[0] == '\0') {
+            fprintf(stderr, "ERRO: Faltam operandos para '%s'.\n", ln->keyword_token);
+            assembly_error();
+        }
+        emit_operand(ln, rest);
+    }
+}
+
+// Gera as palavras de uma linha na seção e no endereço dados, com as mesmas
+// regras (e erros) de assemble_stream; os tokens guardados não são alterados
+static void emit_line(SourceLine *ln, int section, int address)
+{
+    ln->address = address;
+    ln->section_after = section;
+    ln->size = 0;
+    ln->emits = 0;
+    ln->is_instruction = 0;
+    ln->ref_count = 0;
+    ln->code_text[0] = ln->reloc_text[0] = '\0';
+
+    if(ln->kw == KW_SECTION) {
+        if(ln->section) ln->section_after = ln->section;
+        return;
+    }
+    if(!ln->keyword_token || ln->kw == KW_PUBLIC || ln->kw == KW_EXTERN ||
+       ln->kw == KW_BEGIN || ln->kw == KW_END || section == 0) {
+        return;
+    }
+
+    ln->emits = 1;
+    if(address + line_words(section, ln->kw) > MAX_CODE_SIZE) {
+        fprintf(stderr, "ERRO: Código excede %d palavras.\n", MAX_CODE_SIZE);
+        assembly_error();
+    }
+
+    char rest[MAX_LINE_LENGTH] = "";
+    if(ln->rest) strcpy(rest, ln->rest);
+
+    if(section == 1) {
+        if(ln->kw == KW_NONE || ln->kw > KW_LAST_INSTRUCTION) {
+            fprintf(stderr, "ERRO: Instrução desconhecida '%s'.\n", ln->keyword_token);
+            assembly_error();
+        }
+        const OpCode *op = &opcodes[ln->kw - 1];
+        ln->words[0] = op->opcode;
+        ln->reloc[0] = 0;
+        ln->is_instruction = 1;
+        ln->size = 1;
+        if(op->tamanho > 1) emit_operands(ln, rest);
+    } else if(section == 2) {
+        ln->reloc[0] = 0;
+        if(ln->kw == KW_SPACE) {
+            ln->words[0] = 0;
+            ln->size = 1;
+        } else if(ln->kw == KW_CONST) {
+            char *val = strtok(rest, " \t");
+            if(!val) {
+                fprintf(stderr, "ERRO: Falta valor em CONST.\n");
+                assembly_error();
+            }
+            if(strncasecmp(val, "0x", 2) == 0) {
+                ln->words[0] = (int)strtol(val, NULL, 16);
+            } else {
+                ln->words[0] = atoi(val);
+            }
+            ln->size = 1;
+        } else {
+            fprintf(stderr, "ERRO: Diretiva desconhecida '%s'.\n", ln->keyword_token);
+            assembly_error();
+        }
+    }
+    render_line(ln);
+}
+
+// Aplica as declarações de rótulos da linha à tabela de símbolos, na mesma
+// ordem de assemble_stream
+static void declare_labels(AssemblySession *s, SourceLine *ln, int address)
+{
+    SymbolTable *sym = &s->sym;
+    if(ln->label_decl == DECL_EXTERN) {
+        add_label(sym, ln->label, 0, 1, 0, 0);
+    } else if(ln->label_decl == DECL_DEFINE) {
+        add_label(sym, ln->label, address, 0, 0, 1);
+        ln->symbol = find_symbol(sym, ln->label);
+    }
+    if(ln->kw == KW_PUBLIC) {
+        add_label(sym, ln->declared, 0, 0, 1, 0);
+    } else if(ln->kw == KW_EXTERN && ln->declared) {
+        add_label(sym, ln->declared, 0, 1, 0, 0);
     }
+}
+
+// Resolve uma referência da linha pelo endereço atual do rótulo
+static void resolve_reference(AssemblySession *s, SourceLine *ln, LineReference *r)
+{
+    if(r->symbol < 0) {
+        r->symbol = find_symbol(&s->sym, r->label);
+        if(r->symbol < 0) {
+            fprintf(stderr, "ERRO: Rótulo '%s' não definido.\n", r->label);
+            assembly_error();
+        }
+    }
+    const Label *l = &s->sym.labels[r->symbol];
+    ln->words[r->offset] = l->is_extern ? 0 : l->address + r->addend;
+    ln->reloc[r->offset] = 1;
+    render_line(ln);
+}
+
+static void check_reference_count(const AssemblySession *s)
+{
+    if(s->ref_count > MAX_LABELS) {
+        fprintf(stderr, "ERRO: Excedido número máximo de pendências.\n");
+        assembly_error();
+    }
+}
+
+// Refaz a tabela de símbolos, os endereços e as palavras de todas as linhas
+// a partir dos tokens guardados
+static void rebuild_session(AssemblySession *s)
+{
+    s->sym.label_count = 0;
+    s->sym.pending_count = 0;
+    s->begin_lines = 0;
+    s->ref_count = 0;
+    s->always_rebuild = 0;
+
+    int section = 0, address = 0;
+    for(int i = 0; i < s->line_count; i++) {
+        SourceLine *ln = s->lines[i];
+        declare_labels(s, ln, address);
+        emit_line(ln, section, address);
+        section = ln->section_after;
+        address += ln->size;
+        s->begin_lines += ln->has_begin;
+        s->ref_count += ln->ref_count;
+    }
+    s->code_size = address;
+    check_reference_count(s);
+
+    for(int i = 0; i < s->line_count; i++) {
+        SourceLine *ln = s->lines[i];
+        if(ln->label_decl == DECL_DEFINE && s->sym.labels[ln->symbol].is_extern) s->always_rebuild = 1;
+        for(int r = 0; r < ln->ref_count; r++) resolve_reference(s, ln, &ln->refs[r]);
+    }
+}
+
+// Diretiva de declaração da linha (KW_PUBLIC, KW_EXTERN ou KW_NONE)
+static Keyword declaration_keyword(const SourceLine *ln)
+{
+    return (ln->kw == KW_PUBLIC || ln->kw == KW_EXTERN) ? ln->kw : KW_NONE;
+}
+
+// As linhas declaram os mesmos rótulos, do mesmo modo e na mesma ordem?
+// (nesse caso a tabela de símbolos só muda nos endereços)
+static int same_declarations(SourceLine **a, int a_count, SourceLine **b, int b_count)
+{
+    int i = 0, j = 0;
+    for(;;) {
+        while(i < a_count && a[i]->label_decl == DECL_NONE && declaration_keyword(a[i]) == KW_NONE) i++;
+        while(j < b_count && b[j]->label_decl == DECL_NONE && declaration_keyword(b[j]) == KW_NONE) j++;
+        if(i == a_count || j == b_count) return i == a_count && j == b_count;
+
+        const SourceLine *x = a[i++], *y = b[j++];
+        if(x->label_decl != y->label_decl || strcmp(x->label, y->label) != 0) return 0;
+        if(declaration_keyword(x) != declaration_keyword(y)) return 0;
+        if(!x->declared != !y->declared || (x->declared && strcmp(x->declared, y->declared) != 0)) {
+            return 0;
+        }
+    }
+}
+
+// Conclui uma substituição que montou sem erro: libera as linhas antigas
+static void finish_replace(AssemblySession *s)
+{
+    for(int i = 0; i < s->undo_removed_count; i++) free(s->undo_removed[i]);
+    s->undo_removed_count = 0;
+    s->undo_added_count = 0;
+    s->undo_spliced = 0;
+}
+
+// Desfaz uma substituição interrompida por um erro de montagem: devolve as
+// linhas antigas ao lugar e refaz endereços, símbolos e referências a partir
+// delas, que já montavam sem erro
+static void undo_replace(AssemblySession *s)
+{
+    int first = s->undo_first;
+    int removed = s->undo_removed_count, added = s->undo_added_count;
+    if(s->undo_spliced) {
+        memmove(&s->lines[first + removed], &s->lines[first + added],
+                (size_t)(s->line_count - first - added) * sizeof(SourceLine *));
+        memcpy(&s->lines[first], s->undo_removed, (size_t)removed * sizeof(SourceLine *));
+        s->line_count += removed - added;
+    }
+    for(int i = 0; i < added; i++) free(s->undo_added[i]);
+    if(s->undo_spliced) rebuild_session(s);
+    s->undo_removed_count = 0;
+    s->undo_added_count = 0;
+    s->undo_spliced = 0;
+}
+
+// Substitui as linhas [first, first + removed) por 'count' linhas novas
+static SessionUpdate replace_lines(AssemblySession *s, int first, int removed,
+                                   char (*texts)[MAX_LINE_LENGTH], int count)
+{
+    SessionUpdate update = {count, removed, 0, 0};
+    if(s->line_count - removed + count > MAX_SOURCE_LINES) {
+        fprintf(stderr, "ERRO: Excedido número máximo de linhas (%d) na sessão.\n", MAX_SOURCE_LINES);
+        assembly_error();
+    }
+
+    // As linhas antigas ficam guardadas até o fim, para undo_replace
+    s->undo_first = first;
+    memcpy(s->undo_removed, &s->lines[first], (size_t)removed * sizeof(SourceLine *));
+    s->undo_removed_count = removed;
+    s->undo_added_count = 0;
+    s->undo_spliced = 0;
+    SourceLine **added = s->undo_added;
+    for(int i = 0; i < count; i++) {
+        added[i] = lex_line(texts[i]);
+        s->undo_added_count++;
+    }
+
+    // SECTION muda a interpretação das linhas seguintes, e declarações
+    // diferentes mudam a ordem ou os atributos da tabela de símbolos. Uma
+    // sessão vazia (observador que começou com erro) é sempre refeita.
+    int incremental = s->line_count > 0 && !s->always_rebuild &&
+                      same_declarations(&s->lines[first], removed, added, count);
+    int removed_size = 0, removed_refs = 0, removed_begins = 0;
+    for(int i = first; i < first + removed; i++) {
+        SourceLine *ln = s->lines[i];
+        if(ln->kw == KW_SECTION) incremental = 0;
+        removed_size += ln->size;
+        removed_refs += ln->ref_count;
+        removed_begins += ln->has_begin;
+    }
+    for(int i = 0; i < count; i++) {
+        if(added[i]->kw == KW_SECTION) incremental = 0;
+    }
+
+    memmove(&s->lines[first + count], &s->lines[first + removed],
+            (size_t)(s->line_count - first - removed) * sizeof(SourceLine *));
+    memcpy(&s->lines[first], added, (size_t)count * sizeof(SourceLine *));
+    s->line_count += count - removed;
+    s->undo_spliced = 1;
+
+    if(!incremental) {
+        rebuild_session(s);
+        update.resolved = s->ref_count;
+        update.rebuilt = 1;
+        finish_replace(s);
+        return update;
+    }
+
+    // Monta as linhas novas a partir do endereço da primeira removida
+    unsigned char changed[MAX_LABELS] = {0};
+    int section = 0, address = 0;
+    if(first > 0) {
+        const SourceLine *prev = s->lines[first - 1];
+        section = prev->section_after;
+        address = prev->address + prev->size;
+    }
+    int added_size = 0;
+    for(int i = first; i < first + count; i++) {
+        SourceLine *ln = s->lines[i];
+        if(ln->label_decl == DECL_DEFINE) {
+            ln->symbol = find_symbol(&s->sym, ln->label);
+            Label *l = &s->sym.labels[ln->symbol];
+            if(l->address != address) {
+                l->address = address;
+                changed[ln->symbol] = 1;
+            }
+        }
+        emit_line(ln, section, address);
+        section = ln->section_after;
+        address += ln->size;
+        added_size += ln->size;
+        s->begin_lines += ln->has_begin;
+        s->ref_count += ln->ref_count;
+    }
+    s->begin_lines -= removed_begins;
+    s->ref_count -= removed_refs;
+    check_reference_count(s);
+
+    // Desloca as linhas seguintes e os rótulos definidos nelas
+    int delta = added_size - removed_size;
+    if(delta != 0) {
+        for(int i = first + count; i < s->line_count; i++) {
+            SourceLine *ln = s->lines[i];
+            ln->address += delta;
+            if(ln->label_decl == DECL_DEFINE) {
+                s->sym.labels[ln->symbol].address += delta;
+                changed[ln->symbol] = 1;
+            }
+        }
+        s->code_size += delta;
+
+        // O limite vale para o código todo, que termina na última linha
+        if(s->code_size > MAX_CODE_SIZE) {
+            fprintf(stderr, "ERRO: Código excede %d palavras.\n", MAX_CODE_SIZE);
+            assembly_error();
+        }
+    }
+
+    // Resolve as referências novas e as que apontam para rótulos movidos
+    for(int i = first; i < first + count; i++) {
+        SourceLine *ln = s->lines[i];
+        for(int r = 0; r < ln->ref_count; r++) resolve_reference(s, ln, &ln->refs[r]);
+        update.resolved += ln->ref_count;
+    }
+    int any_changed = 0;
+    for(int i = 0; i < s->sym.label_count; i++) any_changed |= changed[i];
+    for(int i = 0; any_changed && i < s->line_count; i++) {
+        if(i == first) i += count;
+        if(i == s->line_count) break;
+        SourceLine *ln = s->lines[i];
+        for(int r = 0; r < ln->ref_count; r++) {
+            if(changed[ln->refs[r].symbol]) {
+                resolve_reference(s, ln, &ln->refs[r]);
+                update.resolved++;
+            }
+        }
+    }
+    finish_replace(s);
+    return update;
+}
+
+// Aloca uma sessão vazia: sem linhas, símbolos nem código
+static AssemblySession *alloc_session(void)
+{
+    AssemblySession *s = calloc(1, sizeof(AssemblySession));
+    if(!s) {
+        fprintf(stderr, "ERRO: Memória insuficiente.\n");
+        exit(1);
+    }
+    return s;
+}
+
+// Inicia uma sessão com a montagem completa da entrada
+AssemblySession *iniciar_sessao(const char *input_filename)
+{
+    AssemblySession *s = alloc_session();
+    int count = read_source_lines(input_filename, s->incoming);
+    for(int i = 0; i < count; i++) s->lines[i] = lex_line(s->incoming[i]);
+    s->line_count = count;
+    rebuild_session(s);
+    return s;
+}
+
+// Relê a entrada e monta de novo só o trecho alterado: as linhas iguais no
+// início e no fim são mantidas e as do meio são substituídas
+SessionUpdate atualizar_sessao(AssemblySession *s, const char *input_filename)
+{
+    int count = read_source_lines(input_filename, s->incoming);
+
+    int prefix = 0;
+    while(prefix < count && prefix < s->line_count &&
+          strcmp(s->incoming[prefix], s->lines[prefix]->text) == 0) {
+        prefix++;
+    }
+    int suffix = 0;
+    while(suffix < count - prefix && suffix < s->line_count - prefix &&
+          strcmp(s->incoming[count - 1 - suffix], s->lines[s->line_count - 1 - suffix]->text) == 0) {
+        suffix++;
+    }
+
+    int removed = s->line_count - prefix - suffix;
+    int added = count - prefix - suffix;
+    if(removed == 0 && added == 0) {
+        SessionUpdate update = {0, 0, 0, 0};
+        return update;
+    }
+    return replace_lines(s, prefix, removed, &s->incoming[prefix], added);
+}
+
+// Grava o código atual da sessão no mesmo formato de montar_programa; as
+// palavras de cada linha já estão formatadas
+void gravar_sessao(AssemblySession *s, const char *output_filename)
+{
+    FILE *out = open_assembler_output(output_filename);
+    if(s->begin_lines > 0) {
+        SymbolTable *sym = &s->sym;
+        sym->pending_count = 0;
+        for(int i = 0; i < s->line_count; i++) {
+            const SourceLine *ln = s->lines[i];
+            for(int r = 0; r < ln->ref_count; r++) {
+                PendingReference *p = &sym->pendings[sym->pending_count++];
+                strcpy(p->label, ln->refs[r].label);
+                p->addend = ln->refs[r].addend;
+                p->instruction_address = ln->address + ln->refs[r].offset;
+            }
+        }
+        print_module_tables(sym, out);
+
+        fputs("R, ", out);
+        for(int i = 0; i < s->line_count; i++) fputs(s->lines[i]->reloc_text, out);
+        fputs("\n", out);
+    }
+    for(int i = 0; i < s->line_count; i++) fputs(s->lines[i]->code_text, out);
+    fputs("\n", out);
+    close_assembler_output(out);
+}
+
+void encerrar_sessao(AssemblySession *s)
+{
+    for(int i = 0; i < s->line_count; i++) free(s->lines[i]);
+    free(s);
+}
+
+// Atualiza a sessão como atualizar_sessao, mas um erro de montagem não
+// encerra o programa: a mensagem vai para stderr, as linhas alteradas são
+// desfeitas e a função devolve 0, com a sessão igual à de antes da chamada
+int tentar_atualizar_sessao(AssemblySession *s, const char *input_filename, SessionUpdate *update)
+{
+    jmp_buf error_return;
+    if(setjmp(error_return)) {
+        assembly_error_return = NULL;
+        undo_replace(s);
+        return 0;
+    }
+    assembly_error_return = &error_return;
+    *update = atualizar_sessao(s, input_filename);
+    assembly_error_return = NULL;
+    return 1;
+}
+
+// Observa a entrada e remonta incrementalmente a cada alteração, gravando
+// a saída e um resumo em stdout. Uma versão com erro de montagem é só
+// informada: a sessão e a saída continuam as da última versão correta, e a
+// próxima alteração é montada a partir delas.
+void observar_programa(const char *input_filename, const char *output_filename)
+{
+    struct stat st;
+    if(stat(input_filename, &st) != 0) {
+        perror("Erro ao abrir arquivo de entrada");
+        exit(1);
+    }
+    struct timespec last = st.st_mtim;
+    off_t last_size = st.st_size;
+
+    // A sessão começa vazia; a primeira atualização monta a entrada toda
+    AssemblySession *s = alloc_session();
+    SessionUpdate update;
+    int written = 0;    // A saída tem uma versão correta
+    if(tentar_atualizar_sessao(s, input_filename, &update)) {
+        gravar_sessao(s, output_filename);
+        written = 1;
+        printf("Montagem concluída. Saída: %s\n", output_filename);
+    } else {
+        printf("Montagem com erro; aguardando uma alteração.\n");
+    }
+    printf("Observando %s (Ctrl+C encerra).\n", input_filename);
+    fflush(stdout);
+
+    const struct timespec interval = {0, 200 * 1000 * 1000};
+    for(;;) {
+        nanosleep(&interval, NULL);
+        if(stat(input_filename, &st) != 0) continue;   // Arquivo sendo substituído pelo editor
+        if(st.st_mtim.tv_sec == last.tv_sec && st.st_mtim.tv_nsec == last.tv_nsec &&
+           st.st_size == last_size) {
+            continue;
+        }
+        last = st.st_mtim;
+        last_size = st.st_size;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if(!tentar_atualizar_sessao(s, input_filename, &update)) {
+            if(written) printf("Montagem com erro; %s continua com a última versão correta.\n", output_filename);
+            else printf("Montagem com erro; aguardando uma alteração.\n");
+            fflush(stdout);
+            continue;
+        }
+        if(update.lexed == 0 && update.removed == 0 && written) {
+            // Só o horário mudou; a saída continua igual
+            continue;
+        }
+        gravar_sessao(s, output_filename);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if(!written) {
+            written = 1;
+            printf("Montagem concluída. Saída: %s\n", output_filename);
+            fflush(stdout);
+            continue;
+        }
+        double ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+        printf("Remontagem: %d linha(s) relida(s), %d removida(s), %d referência(s) resolvida(s)%s, %.3f ms.\n",
+               update.lexed, update.removed, update.resolved,
+               update.rebuilt ? ", tabela de símbolos refeita" : "", ms);
+        fflush(stdout);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Análise estática (--analyze)
+//
+// Monta o programa normalmente e, sobre o código gerado, constrói o grafo de
+// fluxo de controle: blocos básicos separados pelos saltos (JMP, JMPN, JMPP,
+// JMPZ) e por STOP, laços naturais encontrados por dominadores, e código
+// inalcançável. Cada bloco recebe um custo estimado em ciclos e acessos à
+// memória de dados a partir de uma tabela de custos por instrução.
+// ---------------------------------------------------------------------------
+
+#define MAX_BLOCKS   MAX_CODE_SIZE                // Cada instrução pode ser um bloco
+#define BLOCK_WORDS  ((MAX_BLOCKS + 63) / 64)     // Palavras de 64 bits por conjunto de blocos
+#define DEFAULT_LOOP_WEIGHT 10                    // Iterações estimadas por nível de laço
+
+// Custo estimado de uma instrução
+typedef struct {
+    int cycles;     // Ciclos
+    int accesses;   // Acessos à memória de dados (sem contar a busca da instrução)
+} InstructionCost;
+
+// Tabela de custos, indexada pelo opcode; LOOP dá o peso de cada nível de laço
+typedef struct {
+    InstructionCost costs[KW_LAST_INSTRUCTION + 1];
+    int loop_weight;
+} CostTable;
+
+// Bloco básico: instruções de start até end (exclusivo)
+typedef struct {
+    int start, end;
+    int succ[2];          // Sucessores (índices de bloco)
+    int succ_count;
+    int exits;            // Termina em STOP ou salto para fora do módulo
+    int reachable;
+    int depth;            // Quantos laços contêm o bloco
+    int loop;             // Laço mais interno que contém o bloco (-1 se nenhum)
+    long cycles, accesses;
+} BasicBlock;
+
+// Laço natural: cabeçalho e conjunto de blocos do corpo
+typedef struct {
+    int header;
+    uint64_t body[BLOCK_WORDS];
+    int size;
+    int parent;           // Laço imediatamente externo (-1 se nenhum)
+    int depth;
+} Loop;
+
+typedef struct {
+    BasicBlock blocks[MAX_BLOCKS];
+    int block_count;
+    int block_of[MAX_CODE_SIZE];          // Bloco que começa em cada endereço (-1 se nenhum)
+    uint64_t dom[MAX_BLOCKS][BLOCK_WORDS]; // Dominadores de cada bloco
+    Loop loops[MAX_BLOCKS];
+    int loop_count;
+    int irreducible;                      // Arestas de retorno sem dominador (laços irredutíveis)
+} FlowGraph;
+
+#define SET_HAS(set, i)  (((set)[(i) >> 6] >> ((i) & 63)) & 1)
+#define SET_ADD(set, i)  ((set)[(i) >> 6] |= (uint64_t)1 << ((i) & 63))
+
+// Custos padrão: aritmética e acesso à memória custam 1 ciclo, MULT e DIV
+// são mais lentas e INPUT/OUTPUT incluem a espera pela E/S
+void default_costs(CostTable *table)
+{
+    static const InstructionCost defaults[KW_LAST_INSTRUCTION + 1] = {
+        [KW_ADD]  = {1, 1}, [KW_SUB]  = {1, 1}, [KW_MULT] = {4, 1}, [KW_DIV] = {12, 1},
+        [KW_JMP]  = {1, 0}, [KW_JMPN] = {1, 0}, [KW_JMPP] = {1, 0}, [KW_JMPZ] = {1, 0},
+        [KW_COPY] = {2, 2}, [KW_LOAD] = {1, 1}, [KW_STORE] = {1, 1},
+        [KW_INPUT] = {20, 1}, [KW_OUTPUT] = {20, 1}, [KW_STOP] = {1, 0}
+    };
+    memcpy(table->costs, defaults, sizeof(defaults));
+    table->loop_weight = DEFAULT_LOOP_WEIGHT;
+}
+
+// Lê uma tabela de custos: uma instrução por linha, "MNEMONICO ciclos acessos",
+// e opcionalmente "LOOP n" com as iterações estimadas por nível de laço.
+// Instruções ausentes mantêm o custo padrão; ';' inicia um comentário.
+void load_cost_table(const char *filename, CostTable *table)
+{
+    FILE *fp = fopen(filename, "r");
+    if(!fp) {
+        perror("Erro ao abrir tabela de custos");
+        exit(1);
+    }
+
+    char line[MAX_LINE_LENGTH];
+    int line_number = 0;
+    while(fgets(line, sizeof(line), fp)) {
+        line_number++;
+        char *comment = strchr(line, ';');
+        if(comment) *comment = '\0';
+
+        char name[16];
+        int cycles, accesses;
+        int fields = sscanf(line, "%15s %d %d", name, &cycles, &accesses);
+        if(fields <= 0) continue;
+
+        if(strcasecmp(name, "LOOP") == 0 && fields >= 2 && cycles > 0) {
+            table->loop_weight = cycles;
+            continue;
+        }
+
+        Keyword kw = classify_token(name);
+        if(kw == KW_NONE || kw > KW_LAST_INSTRUCTION || fields != 3 || cycles < 0 || accesses < 0) {
+            fprintf(stderr, "ERRO: Linha %d inválida na tabela de custos '%s'.\n", line_number, filename);
+            exit(1);
+        }
+        table->costs[kw].cycles   = cycles;
+        table->costs[kw].accesses = accesses;
+    }
+    fclose(fp);
+}
+
+// Indica se a palavra em addr é uma referência a símbolo EXTERN
+int is_external_reference(const SymbolTable *sym, int addr)
+{
+    for(int i = 0; i < sym->pending_count; i++) {
+        if(sym->pendings[i].instruction_address != addr) continue;
+        for(int j = 0; j < sym->label_count; j++) {
+            if(strcasecmp(sym->labels[j].name, sym->pendings[i].label) == 0) {
+                return sym->labels[j].is_extern;
+            }
+        }
+    }
+    return 0;
+}
+
+// Nome de um endereço para o relatório: o rótulo definido nele, se houver
+const char *label_at(const SymbolTable *sym, int addr)
+{
+    for(int i = 0; i < sym->label_count; i++) {
+        if(sym->labels[i].is_defined && sym->labels[i].address == addr) {
+            return sym->labels[i].name;
+        }
+    }
+    return "";
+}
+
+// Destino de um salto dentro do módulo, ou -1 (EXTERN ou fora do código)
+int jump_target(const Assembly *as, int addr)
+{
+    if(is_external_reference(&as->sym, addr + 1)) return -1;
+    int target = as->code[addr + 1];
+    if(target < 0 || target >= as->code_size || !as->is_instruction[target]) return -1;
+    return target;
+}
+
+// Divide o código em blocos básicos e liga os sucessores
+void build_blocks(const Assembly *as, FlowGraph *g)
+{
+    unsigned char leader[MAX_CODE_SIZE] = {0};
+    int first = -1;
+
+    // Líderes: primeira instrução, destinos de salto e instruções após saltos/STOP
+    for(int addr = 0; addr < as->code_size; addr++) {
+        if(!as->is_instruction[addr]) continue;
+        if(first < 0) {
+            first = addr;
+            leader[addr] = 1;
+        }
+        int op = as->code[addr];
+        int next = addr + opcodes[op - 1].tamanho;
+        if(op >= KW_JMP && op <= KW_JMPZ) {
+            int target = jump_target(as, addr);
+            if(target >= 0) leader[target] = 1;
+            if(next < as->code_size) leader[next] = 1;
+        } else if(op == KW_STOP) {
+            if(next < as->code_size) leader[next] = 1;
+        }
+        // Uma instrução seguida de dados encerra o bloco
+        if(next < as->code_size && !as->is_instruction[next]) leader[next] = 1;
+    }
+
+    g->block_count = 0;
+    for(int addr = 0; addr < MAX_CODE_SIZE; addr++) g->block_of[addr] = -1;
+    for(int addr = 0; addr < as->code_size; addr++) {
+        if(leader[addr] && as->is_instruction[addr]) {
+            BasicBlock *b = &g->blocks[g->block_count];
+            memset(b, 0, sizeof(*b));
+            b->start = addr;
+            b->loop  = -1;
+            g->block_of[addr] = g->block_count++;
+        }
+    }
+
+    for(int i = 0; i < g->block_count; i++) {
+        BasicBlock *b = &g->blocks[i];
+        int addr = b->start;
+        int last = addr;
+        // Percorre as instruções do bloco somando seus custos
+        while(addr < as->code_size && as->is_instruction[addr] &&
+              (addr == b->start || !leader[addr])) {
+            last = addr;
+            addr += opcodes[as->code[addr] - 1].tamanho;
+        }
+        b->end = addr;
+
+        int op = as->code[last];
+        int fallthrough = (op != KW_JMP && op != KW_STOP);
+        if(op >= KW_JMP && op <= KW_JMPZ) {
+            int target = jump_target(as, last);
+            if(target >= 0) {
+                b->succ[b->succ_count++] = g->block_of[target];
+            } else {
+                b->exits = 1;
+                if(!is_external_reference(&as->sym, last + 1)) {
+                    fprintf(stderr, "AVISO: Salto em %d para %d, fora do código.\n", last, as->code[last + 1]);
+                }
+            }
+        }
+        if(op == KW_STOP) b->exits = 1;
+        if(fallthrough) {
+            if(addr < as->code_size && as->is_instruction[addr]) {
+                if(b->succ_count == 0 || b->succ[0] != g->block_of[addr]) {
+                    b->succ[b->succ_count++] = g->block_of[addr];
+                }
+            } else {
+                fprintf(stderr, "AVISO: A execução continua após o fim do código em %d.\n", addr);
+                b->exits = 1;
+            }
+        }
+    }
+}
+
+// Marca os blocos alcançáveis a partir da entrada (endereço da primeira
+// instrução) e, em módulos, dos rótulos PUBLIC, que outros módulos podem usar
+void mark_reachable(const Assembly *as, FlowGraph *g)
+{
+    int stack[MAX_BLOCKS];
+    int top = 0;
+
+    if(g->block_count > 0) {
+        g->blocks[0].reachable = 1;
+        stack[top++] = 0;
+    }
+    for(int i = 0; i < as->sym.label_count; i++) {
+        const Label *l = &as->sym.labels[i];
+        if(!l->is_public || !l->is_defined || l->address >= as->code_size) continue;
+        int b = g->block_of[l->address];
+        if(b >= 0 && !g->blocks[b].reachable) {
+            g->blocks[b].reachable = 1;
+            stack[top++] = b;
+        }
+    }
+
+    while(top > 0) {
+        BasicBlock *b = &g->blocks[stack[--top]];
+        for(int s = 0; s < b->succ_count; s++) {
+            BasicBlock *next = &g->blocks[b->succ[s]];
+            if(!next->reachable) {
+                next->reachable = 1;
+                stack[top++] = b->succ[s];
+            }
+        }
+    }
+}
+
+// Dominadores pelo método iterativo sobre conjuntos de bits: os pontos de
+// entrada dominam só a si mesmos e os demais blocos começam com todos
+void compute_dominators(const Assembly *as, FlowGraph *g)
+{
+    int n = g->block_count;
+    unsigned char entry[MAX_BLOCKS] = {0};
+    if(n > 0) entry[0] = 1;
+    for(int i = 0; i < as->sym.label_count; i++) {
+        const Label *l = &as->sym.labels[i];
+        if(l->is_public && l->is_defined && l->address < as->code_size &&
+           g->block_of[l->address] >= 0) {
+            entry[g->block_of[l->address]] = 1;
+        }
+    }
+
+    for(int i = 0; i < n; i++) {
+        memset(g->dom[i], entry[i] ? 0 : 0xFF, sizeof(g->dom[i]));
+        if(entry[i]) SET_ADD(g->dom[i], i);
+    }
+
+    int changed = 1;
+    while(changed) {
+        changed = 0;
+        for(int i = 0; i < n; i++) {
+            if(entry[i] || !g->blocks[i].reachable) continue;
+            uint64_t next[BLOCK_WORDS];
+            memset(next, 0xFF, sizeof(next));
+            for(int p = 0; p < n; p++) {
+                const BasicBlock *pred = &g->blocks[p];
+                if(!pred->reachable) continue;
+                if((pred->succ_count > 0 && pred->succ[0] == i) ||
+                   (pred->succ_count > 1 && pred->succ[1] == i)) {
+                    for(int w = 0; w < BLOCK_WORDS; w++) next[w] &= g->dom[p][w];
+                }
+            }
+            SET_ADD(next, i);
+            if(memcmp(next, g->dom[i], sizeof(next)) != 0) {
+                memcpy(g->dom[i], next, sizeof(next));
+                changed = 1;
+            }
+        }
+    }
+}
+
+// Encontra os laços naturais: cada aresta u -> h em que h domina u fecha um
+// laço com cabeçalho h; laços com o mesmo cabeçalho são unidos. Arestas para
+// trás sem dominância indicam laços irredutíveis, que só são contados.
+void find_loops(FlowGraph *g)
+{
+    int n = g->block_count;
+    g->loop_count  = 0;
+    g->irreducible = 0;
+
+    for(int u = 0; u < n; u++) {
+        BasicBlock *b = &g->blocks[u];
+        if(!b->reachable) continue;
+        for(int s = 0; s < b->succ_count; s++) {
+            int h = b->succ[s];
+            if(!SET_HAS(g->dom[u], h)) {
+                if(g->blocks[h].start <= b->start) g->irreducible++;
+                continue;
+            }
+
+            Loop *loop = NULL;
+            for(int l = 0; l < g->loop_count; l++) {
+                if(g->loops[l].header == h) loop = &g->loops[l];
+            }
+            if(!loop) {
+                loop = &g->loops[g->loop_count++];
+                memset(loop, 0, sizeof(*loop));
+                loop->header = h;
+                SET_ADD(loop->body, h);
+            }
+
+            // Corpo: blocos que alcançam u sem passar pelo cabeçalho
+            int stack[MAX_BLOCKS];
+            int top = 0;
+            if(!SET_HAS(loop->body, u)) {
+                SET_ADD(loop->body, u);
+                stack[top++] = u;
+            }
+            while(top > 0) {
+                int v = stack[--top];
+                for(int p = 0; p < n; p++) {
+                    const BasicBlock *pred = &g->blocks[p];
+                    if(!pred->reachable || SET_HAS(loop->body, p)) continue;
+                    if((pred->succ_count > 0 && pred->succ[0] == v) ||
+                       (pred->succ_count > 1 && pred->succ[1] == v)) {
+                        SET_ADD(loop->body, p);
+                        stack[top++] = p;
+                    }
+                }
+            }
+        }
+    }
+
+    for(int l = 0; l < g->loop_count; l++) {
+        Loop *loop = &g->loops[l];
+        loop->size = 0;
+        for(int i = 0; i < n; i++) loop->size += SET_HAS(loop->body, i);
+    }
+
+    // Aninhamento: o pai é o menor laço que contém o cabeçalho e é maior
+    for(int l = 0; l < g->loop_count; l++) {
+        Loop *loop = &g->loops[l];
+        loop->parent = -1;
+        for(int o = 0; o < g->loop_count; o++) {
+            const Loop *outer = &g->loops[o];
+            if(o == l || !SET_HAS(outer->body, loop->header) || outer->size <= loop->size) continue;
+            if(loop->parent < 0 || outer->size < g->loops[loop->parent].size) loop->parent = o;
+        }
+    }
+    for(int l = 0; l < g->loop_count; l++) {
+        int depth = 0;
+        for(int p = l; p >= 0; p = g->loops[p].parent) depth++;
+        g->loops[l].depth = depth;
+    }
+
+    // Profundidade de cada bloco e seu laço mais interno
+    for(int l = 0; l < g->loop_count; l++) {
+        for(int i = 0; i < n; i++) {
+            if(!SET_HAS(g->loops[l].body, i)) continue;
+            BasicBlock *b = &g->blocks[i];
+            b->depth++;
+            if(b->loop < 0 || g->loops[l].size < g->loops[b->loop].size) b->loop = l;
+        }
+    }
+}
+
+// Soma os custos das instruções de cada bloco
+void estimate_costs(const Assembly *as, const CostTable *table, FlowGraph *g)
+{
+    for(int i = 0; i < g->block_count; i++) {
+        BasicBlock *b = &g->blocks[i];
+        b->cycles = b->accesses = 0;
+        for(int addr = b->start; addr < b->end; addr += opcodes[as->code[addr] - 1].tamanho) {
+            b->cycles   += table->costs[as->code[addr]].cycles;
+            b->accesses += table->costs[as->code[addr]].accesses;
+        }
+    }
+}
+
+// Peso de um bloco: loop_weight elevado ao número de níveis de laço
+long long nesting_weight(const CostTable *table, int levels)
+{
+    long long weight = 1;
+    for(int i = 0; i < levels; i++) weight *= table->loop_weight;
+    return weight;
+}
+
+void print_block_name(const Assembly *as, const FlowGraph *g, int block, FILE *out)
+{
+    const char *name = label_at(&as->sym, g->blocks[block].start);
+    if(*name) fprintf(out, "B%d (%s)", block, name);
+    else      fprintf(out, "B%d", block);
+}
+
+void print_analysis(const char *input_filename, const Assembly *as, const CostTable *table,
+                    const FlowGraph *g, FILE *out)
+{
+    int text_words = 0;
+    for(int i = 0; i < g->block_count; i++) text_words += g->blocks[i].end - g->blocks[i].start;
+
+    fprintf(out, "Análise de %s (%s): %d palavras de código, %d de dados\n",
+            strcmp(input_filename, "-") == 0 ? "entrada padrão" : input_filename,
+            as->has_begin_end ? "módulo" : "programa",
+            text_words, as->code_size - text_words);
+
+    fprintf(out, "\nBlocos básicos: %d\n", g->block_count);
+    for(int i = 0; i < g->block_count; i++) {
+        const BasicBlock *b = &g->blocks[i];
+        char range[32];
+        snprintf(range, sizeof(range), "[%d-%d]", b->start, b->end - 1);
+        fprintf(out, "  B%-4d %-11s %-12s ciclos %-5ld acessos %-5ld profundidade %d  ->",
+                i, range, label_at(&as->sym, b->start),
+                b->cycles, b->accesses, b->depth);
+        for(int s = 0; s < b->succ_count; s++) fprintf(out, " B%d", b->succ[s]);
+        if(b->exits) fprintf(out, " fim");
+        if(!b->reachable) fprintf(out, "  (inalcançável)");
+        fprintf(out, "\n");
+    }
+
+    fprintf(out, "\nLaços: %d\n", g->loop_count);
+    for(int l = 0; l < g->loop_count; l++) {
+        const Loop *loop = &g->loops[l];
+        // Custo de uma iteração: laços internos pesam loop_weight por nível
+        long long cycles = 0, accesses = 0;
+        for(int i = 0; i < g->block_count; i++) {
+            if(!SET_HAS(loop->body, i)) continue;
+            long long weight = nesting_weight(table, g->blocks[i].depth - loop->depth);
+            cycles   += g->blocks[i].cycles * weight;
+            accesses += g->blocks[i].accesses * weight;
+        }
+        fprintf(out, "  L%-4d cabeçalho ", l);
+        print_block_name(as, g, loop->header, out);
+        fprintf(out, ", profundidade %d", loop->depth);
+        if(loop->parent >= 0) fprintf(out, " (dentro de L%d)", loop->parent);
+        fprintf(out, ", %d blocos:", loop->size);
+        for(int i = 0; i < g->block_count; i++) {
+            if(SET_HAS(loop->body, i)) fprintf(out, " B%d", i);
+        }
+        fprintf(out, "\n         por iteração: ciclos %lld, acessos %lld\n", cycles, accesses);
+    }
+    if(g->irreducible) {
+        fprintf(out, "  %d aresta(s) de retorno em laços irredutíveis (não analisados)\n", g->irreducible);
+    }
+
+    fprintf(out, "\nCódigo inalcançável:");
+    int unreachable = 0;
+    for(int i = 0; i < g->block_count; i++) {
+        const BasicBlock *b = &g->blocks[i];
+        if(b->reachable) continue;
+        // Junta blocos inalcançáveis consecutivos num só trecho
+        int j = i;
+        while(j + 1 < g->block_count && !g->blocks[j + 1].reachable &&
+              g->blocks[j + 1].start == g->blocks[j].end) j++;
+        fprintf(out, "\n  [%d-%d] %s (%d palavras)", b->start, g->blocks[j].end - 1,
+                label_at(&as->sym, b->start), g->blocks[j].end - b->start);
+        unreachable += g->blocks[j].end - b->start;
+        i = j;
+    }
+    fprintf(out, unreachable ? "\n" : " nenhum\n");
+
+    long long cycles = 0, accesses = 0;
+    for(int i = 0; i < g->block_count; i++) {
+        const BasicBlock *b = &g->blocks[i];
+        if(!b->reachable) continue;
+        long long weight = nesting_weight(table, b->depth);
+        cycles   += b->cycles * weight;
+        accesses += b->accesses * weight;
+    }
+    fprintf(out, "\nCusto estimado (%d iterações por nível de laço): ciclos %lld, acessos %lld\n",
+            table->loop_weight, cycles, accesses);
+}
+
+// Análise estática do programa: monta a entrada e escreve o relatório do
+// grafo de fluxo de controle em output_filename ("-" é a saída padrão).
+// cost_filename (opcional) substitui os custos padrão das instruções.
+void analisar_programa(const char *input_filename, const char *output_filename,
+                       const char *cost_filename)
+{
+    static Assembly as;
+    static FlowGraph graph;
+    CostTable table;
+
+    default_costs(&table);
+    if(cost_filename) load_cost_table(cost_filename, &table);
+
+    FILE *fp = open_assembler_input(input_filename);
+    assemble_stream(fp, &as);
+    if(fp != stdin) fclose(fp);
+
+    build_blocks(&as, &graph);
+    mark_reachable(&as, &graph);
+    compute_dominators(&as, &graph);
+    find_loops(&graph);
+    estimate_costs(&as, &table, &graph);
 
-    fclose(out);
+    FILE *out = open_assembler_output(output_filename);
+    print_analysis(input_filename, &as, &table, &graph, out);
+    close_assembler_output(out);
 }
@@ -7,6 +7,39 @@ typedef struct {
     int tamanho;
 } OpCode;
 
+// Palavras-chave do montador: as instruções têm o valor do próprio opcode
+// (1 a 14), seguidas das diretivas
+typedef enum {
+    KW_NONE = 0,
+    KW_ADD, KW_SUB, KW_MULT, KW_DIV, KW_JMP, KW_JMPN, KW_JMPP, KW_JMPZ,
+    KW_COPY, KW_LOAD, KW_STORE, KW_INPUT, KW_OUTPUT, KW_STOP,
+    KW_SECTION, KW_PUBLIC, KW_EXTERN, KW_BEGIN, KW_END, KW_SPACE, KW_CONST
+} Keyword;
+
+#define KW_LAST_INSTRUCTION KW_STOP
+
+// Sessão de montagem incremental: guarda as linhas separadas em tokens, os
+// endereços e a tabela de símbolos para remontar só o que mudou
+typedef struct AssemblySession AssemblySession;
+
+// Resultado de uma atualização da sessão
+typedef struct {
+    int lexed;      // Linhas novas ou alteradas, separadas em tokens de novo
+    int removed;    // Linhas substituídas ou apagadas
+    int resolved;   // Referências resolvidas de novo
+    int rebuilt;    // Endereços e símbolos refeitos (mudou SECTION ou uma declaração)
+} SessionUpdate;
+
+Keyword classify_token(const char *token);
 void montar_programa(const char *input_filename, const char *output_filename);
+AssemblySession *iniciar_sessao(const char *input_filename);
+SessionUpdate atualizar_sessao(AssemblySession *session, const char *input_filename);
+int tentar_atualizar_sessao(AssemblySession *session, const char *input_filename,
+                            SessionUpdate *update);
+void gravar_sessao(AssemblySession *session, const char *output_filename);
+void encerrar_sessao(AssemblySession *session);
+void observar_programa(const char *input_filename, const char *output_filename);
+void analisar_programa(const char *input_filename, const char *output_filename,
+                       const char *cost_filename);
 
 #endif // MONTADOR_H
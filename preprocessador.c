@@ -2,46 +2,441 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
-#define MAX_LINES 1000
-#define MAX_MACROS 100
-#define MAX_MACRO_LINES 50
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "preprocessador.h"
+
+#define MACRO_TABLE_INITIAL 64   // Capacidade inicial da tabela hash de macros (potência de 2)
+#define MAX_MACRO_PARAMS 16      // Número máximo de parâmetros por macro
+#define MAX_MACRO_DEPTH 16       // Profundidade máxima de macros chamando macros
+#define MAX_THREADS 64           // Número máximo de threads no modo paralelo
+#define PARALLEL_MIN_SIZE (1 << 20) // Entradas menores que isso são sempre processadas em série
+#define STREAM_BLOCK_SIZE (1 << 16) // Bytes lidos por vez quando a entrada não pode ser mapeada
+
+// Trecho de texto guardado no arena (offset em vez de ponteiro,
+// pois o arena pode ser realocado ao crescer)
+typedef struct {
+    size_t offset;               // Início do trecho dentro do arena
+    size_t length;               // Tamanho do trecho, sem terminador
+} LineSlice;
+
+// Trecho do modelo de expansão: texto literal ou posição de um argumento
+typedef struct {
+    int param;                   // Índice do parâmetro, ou -1 para texto literal
+    LineSlice text;              // Texto literal no arena (quando param == -1)
+} TemplateSegment;
 
 // Estrutura para armazenar informações sobre macros
 typedef struct {
-    char name[50];               // Nome da macro
-    char lines[MAX_MACRO_LINES][256]; // Corpo da macro (código associado)
+    LineSlice name;              // Nome da macro
+    size_t first_line;           // Índice da primeira linha do corpo em macro_lines
     int line_count;              // Número de linhas dentro da macro
+    size_t first_param;          // Índice do primeiro parâmetro em macro_params
+    int param_count;             // Número de parâmetros (&A, &B, ...)
+    size_t first_segment;        // Índice do primeiro trecho do modelo em macro_segments
+    int segment_count;           // Número de trechos do modelo compilado
+    size_t literal_length;       // Soma dos tamanhos dos trechos literais
+    size_t defined_at;           // Posição da linha MACRO na entrada
 } Macro;
 
-Macro macros[MAX_MACROS]; // Lista de macros definidas
-int macro_count = 0;      // Contador de macros registradas
+static char *text_arena = NULL;         // Nomes, corpos de macros e constantes, cada trecho terminado em '\0'
+static size_t arena_length = 0;
+static size_t arena_capacity = 0;
 
-// Função para processar uma linha removendo espaços extras, comentários e convertendo para maiúsculas
-void preprocess_line(char *line) {
-    char *comment = strchr(line, ';'); // Identifica início de um comentário
-    if (comment) {
-        *comment = '\0'; // Remove comentário
+static LineSlice *macro_lines = NULL;   // Linhas de todos os corpos, já separadas
+static size_t macro_line_count = 0;
+static size_t macro_line_capacity = 0;
+
+static LineSlice *macro_params = NULL;  // Nomes dos parâmetros de todas as macros, sem o '&'
+static size_t macro_param_count = 0;
+static size_t macro_param_capacity = 0;
+
+static TemplateSegment *macro_segments = NULL; // Modelos compilados de todas as macros
+static size_t macro_segment_count = 0;
+static size_t macro_segment_capacity = 0;
+
+// Buffers de trabalho de emit_line: um conjunto por thread no modo paralelo
+static _Thread_local char *expand_buffers[MAX_MACRO_DEPTH]; // Buffer de expansão de cada nível
+static _Thread_local size_t expand_capacities[MAX_MACRO_DEPTH];
+
+static Macro *macros = NULL;            // Lista de macros definidas
+static int macro_count = 0;             // Contador de macros registradas
+static size_t macro_capacity = 0;
+
+// Constante definida por EQU
+typedef struct {
+    LineSlice name;              // Nome da constante
+    int value;                   // Valor já avaliado
+} EquConstant;
+
+static EquConstant *constants = NULL;   // Lista de constantes definidas por EQU
+static int constant_count = 0;
+static size_t constant_capacity = 0;
+
+static int skip_next_line = 0;          // Linha seguinte a um IF falso deve ser descartada
+
+static _Thread_local char *subst_buffer = NULL; // Linha com as constantes substituídas
+static _Thread_local size_t subst_capacity = 0;
+
+// Texto acumulado em memória
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} TextBuffer;
+
+// No modo paralelo cada thread escreve as linhas do seu trecho aqui, em vez
+// de mandá-las para associate_labels; NULL no modo serial
+static _Thread_local TextBuffer *chunk_output = NULL;
+static _Thread_local size_t current_line_offset = 0; // Posição na entrada da linha sendo processada
+static atomic_int needs_serial = 0;     // Uma thread encontrou EQU/IF e o modo paralelo foi abandonado
+
+// Estado da reordenação de seções: a SECTION TEXT vai direto para a saída
+// e somente a SECTION DATA fica guardada, para ser escrita no final
+static int current_section = 0;         // Seção atual (0=antes de SECTION, 1=TEXT, 2=DATA)
+static int text_header_written = 0;     // "SECTION TEXT" já foi escrita na saída
+static int data_seen = 0;               // Houve alguma SECTION DATA na entrada
+
+static char *data_section = NULL;       // Linhas da SECTION DATA, separadas por '\n'
+static size_t data_length = 0;
+static size_t data_capacity = 0;
+
+#define OUTPUT_BUFFER_SIZE (1 << 16)
+static char output_buffer[OUTPUT_BUFFER_SIZE]; // Linhas da TEXT aguardando escrita em bloco
+static size_t output_length = 0;
+
+static char *pending_label = NULL;      // Rótulo sozinho esperando a próxima linha
+static size_t pending_label_length = 0;
+static size_t pending_label_capacity = 0;
+static char *statement_buffer = NULL;   // Rótulo sozinho juntado à linha seguinte em emit_line
+static size_t statement_capacity = 0;
+
+static char *join_buffer = NULL;        // Rótulo + linha seguinte
+static size_t join_capacity = 0;
+
+// Tabela hash (endereçamento aberto) com índices em um vetor de entradas, -1 = vazio
+typedef struct {
+    int *slots;
+    size_t size;                          // Potência de 2
+    LineSlice (*name_of)(int index);      // Nome da entrada de índice 'index'
+} NameTable;
+
+static LineSlice macro_name_of(int index);
+static LineSlice constant_name_of(int index);
+
+static NameTable macro_table = { NULL, 0, macro_name_of };
+static NameTable constant_table = { NULL, 0, constant_name_of };
+
+// Realoca um vetor dobrando a capacidade até caber 'needed' elementos
+static void *grow_array(void *array, size_t *capacity, size_t needed, size_t elem_size) {
+    if (needed <= *capacity) return array;
+    size_t new_capacity = *capacity ? *capacity : 16;
+    while (new_capacity < needed) new_capacity *= 2;
+    void *grown = realloc(array, new_capacity * elem_size);
+    if (!grown) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        exit(1);
     }
+    *capacity = new_capacity;
+    return grown;
+}
 
-    // Remove espaços em branco no início da linha
-    char *start = line;
-    while (isspace((unsigned char)*start)) start++;
+// Copia um trecho para o arena e retorna sua posição
+static LineSlice arena_store(const char *text, size_t length) {
+    text_arena = grow_array(text_arena, &arena_capacity, arena_length + length + 1, 1);
+    LineSlice slice = { arena_length, length };
+    memcpy(text_arena + arena_length, text, length);
+    text_arena[arena_length + length] = '\0';
+    arena_length += length + 1;
+    return slice;
+}
 
-    // Remove espaços em branco no final da linha
-    char *end = line + strlen(line) - 1;
-    while (end > start && isspace((unsigned char)*end)) *end-- = '\0';
+// Ponteiro para o texto de um trecho do arena (válido até o próximo arena_store)
+static const char *slice_text(LineSlice slice) {
+    return text_arena + slice.offset;
+}
 
-    // Move a linha processada para o início do buffer
-    memmove(line, start, strlen(start) + 1);
+// Hash FNV-1a de um nome
+static size_t hash_name(const char *name, size_t length) {
+    size_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-    // Converte todos os caracteres para maiúsculas
-    for (char *p = line; *p; p++) {
-        *p = toupper((unsigned char)*p);
+static LineSlice macro_name_of(int index) {
+    return macros[index].name;
+}
+
+static LineSlice constant_name_of(int index) {
+    return constants[index].name;
+}
+
+// Insere um índice na tabela hash, sem verificar duplicatas
+static void name_table_insert(NameTable *t, int index) {
+    LineSlice name = t->name_of(index);
+    size_t mask = t->size - 1;
+    size_t pos = hash_name(slice_text(name), name.length) & mask;
+    while (t->slots[pos] != -1) pos = (pos + 1) & mask;
+    t->slots[pos] = index;
+}
+
+// Garante espaço para mais uma entrada além de 'count', dobrando a tabela
+// quando a ocupação passaria de 70%
+static void name_table_reserve(NameTable *t, int count) {
+    if (t->size && (size_t)(count + 1) * 10 < t->size * 7) return;
+
+    free(t->slots);
+    t->size = t->size ? t->size * 2 : MACRO_TABLE_INITIAL;
+    t->slots = malloc(t->size * sizeof(int));
+    if (!t->slots) {
+        fprintf(stderr, "Erro: Memória insuficiente\n");
+        exit(1);
     }
+    for (size_t i = 0; i < t->size; i++) t->slots[i] = -1;
+    for (int i = 0; i < count; i++) name_table_insert(t, i);
+}
+
+// Busca um nome (não necessariamente terminado em '\0') e retorna o índice da entrada, ou -1
+static int name_table_find(const NameTable *t, const char *name, size_t length) {
+    if (t->size == 0) return -1;
+
+    size_t mask = t->size - 1;
+    for (size_t pos = hash_name(name, length) & mask; t->slots[pos] != -1; pos = (pos + 1) & mask) {
+        LineSlice entry = t->name_of(t->slots[pos]);
+        if (entry.length == length && memcmp(slice_text(entry), name, length) == 0) {
+            return t->slots[pos];
+        }
+    }
+    return -1;
+}
+
+static void name_table_free(NameTable *t) {
+    free(t->slots);
+    t->slots = NULL;
+    t->size = 0;
+}
+
+// Libera os buffers de trabalho da thread atual
+static void free_thread_buffers(void) {
+    free(subst_buffer);
+    subst_buffer = NULL;
+    subst_capacity = 0;
+    for (int i = 0; i < MAX_MACRO_DEPTH; i++) {
+        free(expand_buffers[i]);
+        expand_buffers[i] = NULL;
+        expand_capacities[i] = 0;
+    }
+}
+
+// Libera todas as estruturas de macros, constantes e seções
+static void free_preprocessor_state(void) {
+    free(text_arena);
+    free(macro_lines);
+    free(macros);
+    free(constants);
+    free(data_section);
+    free(pending_label);
+    free(join_buffer);
+    free(statement_buffer);
+    name_table_free(&macro_table);
+    name_table_free(&constant_table);
+    free(macro_params);
+    free(macro_segments);
+    free_thread_buffers();
+    text_arena = NULL;
+    macro_lines = NULL;
+    macros = NULL;
+    constants = NULL;
+    data_section = NULL;
+    pending_label = NULL;
+    join_buffer = NULL;
+    statement_buffer = NULL;
+    macro_params = NULL;
+    macro_segments = NULL;
+    arena_length = arena_capacity = 0;
+    macro_line_count = macro_line_capacity = 0;
+    macro_param_count = macro_param_capacity = 0;
+    macro_segment_count = macro_segment_capacity = 0;
+    macro_count = macro_capacity = 0;
+    constant_count = constant_capacity = 0;
+    skip_next_line = 0;
+    current_section = text_header_written = data_seen = 0;
+    data_length = data_capacity = 0;
+    pending_label_length = pending_label_capacity = 0;
+    join_capacity = statement_capacity = 0;
+    output_length = 0;
+}
+
+// Abre a entrada para leitura; "-" é a entrada padrão
+static int open_input(const char *filename) {
+    if (strcmp(filename, "-") == 0) return STDIN_FILENO;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Erro ao abrir o arquivo de entrada"); // Exibe mensagem de erro se o arquivo não for encontrado
+        exit(1);
+    }
+    return fd;
+}
+
+// Abre a saída para escrita; "-" é a saída padrão
+static FILE *open_output(const char *filename) {
+    if (strcmp(filename, "-") == 0) return stdout;
+    FILE *output_file = fopen(filename, "w");
+    if (!output_file) {
+        perror("Erro ao criar o arquivo de saída"); // Exibe mensagem de erro ao tentar criar o arquivo de saída
+        exit(1);
+    }
+    return output_file;
+}
+
+static void close_output(FILE *output_file) {
+    if (output_file == stdout) {
+        fflush(output_file);
+    } else {
+        fclose(output_file);
+    }
+}
+
+// Mapeia a entrada inteira em memória (somente leitura). Retorna 0 se 'fd'
+// não é um arquivo comum (pipe, terminal) ou o mmap falhou; nesse caso a
+// entrada é lida em blocos por process_stream.
+static int map_input(int fd, const char **data, size_t *size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return 0;
+
+    *size = (size_t)st.st_size;
+    *data = NULL;
+    if (*size == 0) return 1;
+
+    void *mapped = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) return 0;
+    madvise(mapped, *size, MADV_SEQUENTIAL);
+    *data = mapped;
+    return 1;
 }
 
-// Função para corrigir formatação da instrução COPY
+static void unmap_input(const char *data, size_t size) {
+    if (size > 0) munmap((void *)data, size);
+}
+
+// Procura o fim da linha que começa em 'p' (o '\n' ou 'end') e o primeiro
+// ';' antes dele. Compara 32 (AVX2) ou 16 (SSE2) bytes por vez.
+static const char *scan_line(const char *p, const char *end, const char **comment) {
+    const char *semicolon = NULL;
+
+#if defined(__AVX2__)
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i semi = _mm256_set1_epi8(';');
+    while (end - p >= 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)p);
+        unsigned nl_mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+        unsigned sc_mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, semi));
+        if (!semicolon && sc_mask) {
+            // Só conta o ';' se ele vier antes do '\n' deste bloco
+            unsigned before_nl = nl_mask ? (nl_mask & (0u - nl_mask)) - 1 : ~0u;
+            if (sc_mask & before_nl) semicolon = p + __builtin_ctz(sc_mask);
+        }
+        if (nl_mask) {
+            *comment = semicolon;
+            return p + __builtin_ctz(nl_mask);
+        }
+        p += 32;
+    }
+#elif defined(__SSE2__)
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i semi = _mm_set1_epi8(';');
+    while (end - p >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)p);
+        unsigned nl_mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+        unsigned sc_mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, semi));
+        if (!semicolon && sc_mask) {
+            // Só conta o ';' se ele vier antes do '\n' deste bloco
+            unsigned before_nl = nl_mask ? (nl_mask & (0u - nl_mask)) - 1 : ~0u;
+            if (sc_mask & before_nl) semicolon = p + __builtin_ctz(sc_mask);
+        }
+        if (nl_mask) {
+            *comment = semicolon;
+            return p + __builtin_ctz(nl_mask);
+        }
+        p += 16;
+    }
+#endif
+
+    // Resto da linha (ou máquina sem SIMD), byte a byte
+    for (; p < end && *p != '\n'; p++) {
+        if (!semicolon && *p == ';') semicolon = p;
+    }
+    *comment = semicolon;
+    return p;
+}
+
+// Copia 'length' bytes de 'src' para 'dst' convertendo a-z para maiúsculas,
+// 32 ou 16 bytes por vez. 'dst' pode ser igual a 'src' ou estar antes dele.
+static void copy_upper(char *dst, const char *src, size_t length) {
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i after_z = _mm256_set1_epi8('z' + 1);
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(block, before_a),
+                                         _mm256_cmpgt_epi8(after_z, block));
+        block = _mm256_sub_epi8(block, _mm256_and_si256(lower, case_bit));
+        _mm256_storeu_si256((__m256i *)(dst + i), block);
+    }
+#elif defined(__SSE2__)
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(block, before_a),
+                                      _mm_cmpgt_epi8(after_z, block));
+        block = _mm_sub_epi8(block, _mm_and_si128(lower, case_bit));
+        _mm_storeu_si128((__m128i *)(dst + i), block);
+    }
+#endif
+
+    for (; i < length; i++) {
+        char c = src[i];
+        dst[i] = (c >= 'a' && c <= 'z') ? (char)(c - 0x20) : c;
+    }
+}
+
+// Normaliza o trecho [src, src + length) -- já sem comentário -- em 'dst':
+// remove espaços nas pontas e converte para maiúsculas. Retorna o tamanho
+// resultante; 'dst' recebe o terminador '\0'.
+static size_t normalize_line(const char *src, size_t length, char *dst) {
+    while (length > 0 && isspace((unsigned char)*src)) { src++; length--; }
+    while (length > 0 && isspace((unsigned char)src[length - 1])) length--;
+    copy_upper(dst, src, length);
+    dst[length] = '\0';
+    return length;
+}
+
+// Função para processar uma linha removendo espaços extras, comentários e convertendo para maiúsculas
+void preprocess_line(char *line) {
+    char *comment = strchr(line, ';'); // Identifica início de um comentário
+    size_t length = comment ? (size_t)(comment - line) : strlen(line);
+    normalize_line(line, length, line);
+}
+
+// Função para corrigir formatação da instrução COPY: remove os espaços em
+// volta da vírgula compactando a linha numa única passagem
 void fix_copy_instruction(char *line) {
     char *copy_keyword = "COPY";
     if (strncmp(line, copy_keyword, 4) == 0) { // Verifica se a linha começa com "COPY"
@@ -52,122 +447,887 @@ void fix_copy_instruction(char *line) {
 
         char *comma = strchr(operands, ','); // Encontra a vírgula separando os operandos
         if (comma) {
-            // Remove espaços antes da vírgula
-            char *before_comma = comma - 1;
-            while (before_comma > operands && isspace((unsigned char)*before_comma)) {
-                memmove(before_comma, before_comma + 1, strlen(before_comma));
-                comma--;
+            // Recua sobre os espaços antes da vírgula
+            char *write = comma;
+            while (write > operands && isspace((unsigned char)write[-1])) write--;
+            *write++ = ',';
+
+            // Pula os espaços após a vírgula e desloca o resto de uma vez
+            char *read = comma + 1;
+            while (isspace((unsigned char)*read)) read++;
+            if (write != read) memmove(write, read, strlen(read) + 1);
+        }
+    }
+}
+
+// Busca uma macro pelo nome (não necessariamente terminado em '\0') e retorna seu índice
+int find_macro(const char *name, size_t length) {
+    return name_table_find(&macro_table, name, length);
+}
+
+// Verifica se o caractere pode fazer parte de um nome (rótulo, macro ou parâmetro)
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Remove espaços no início e no fim de um trecho [*start, *start + *length)
+static void trim_slice(const char **start, size_t *length) {
+    while (*length > 0 && isspace((unsigned char)**start)) { (*start)++; (*length)--; }
+    while (*length > 0 && isspace((unsigned char)(*start)[*length - 1])) (*length)--;
+}
+
+// Registra uma nova macro cujo corpo começa na próxima linha acrescentada
+// a macro_lines; o corpo é gravado direto no arena, sem cópias intermediárias.
+// 'params' é o restante da linha MACRO ("&A, &B"), ou NULL se não houver.
+static Macro *begin_macro(const char *name, const char *params) {
+    if (find_macro(name, strlen(name)) != -1) {
+        fprintf(stderr, "Erro: Macro '%s' redefinida\n", name);
+        exit(1);
+    }
+    name_table_reserve(&macro_table, macro_count);
+    macros = grow_array(macros, &macro_capacity, (size_t)macro_count + 1, sizeof(Macro));
+
+    Macro *m = &macros[macro_count];
+    m->name = arena_store(name, strlen(name));
+    m->first_line = macro_line_count;
+    m->line_count = 0;
+    m->first_param = macro_param_count;
+    m->param_count = 0;
+    m->first_segment = 0;
+    m->segment_count = 0;
+    m->literal_length = 0;
+    m->defined_at = current_line_offset;
+
+    // Lê a lista de parâmetros separados por vírgula
+    while (params && *params) {
+        const char *comma = strchr(params, ',');
+        size_t length = comma ? (size_t)(comma - params) : strlen(params);
+        const char *param = params;
+        trim_slice(&param, &length);
+        if (length < 2 || param[0] != '&') {
+            fprintf(stderr, "Erro: Parâmetro inválido na macro '%s'\n", name);
+            exit(1);
+        }
+        if (m->param_count >= MAX_MACRO_PARAMS) {
+            fprintf(stderr, "Erro: Número máximo de parâmetros na macro '%s' excedido\n", name);
+            exit(1);
+        }
+        macro_params = grow_array(macro_params, &macro_param_capacity, macro_param_count + 1, sizeof(LineSlice));
+        macro_params[macro_param_count++] = arena_store(param + 1, length - 1);
+        m->param_count++;
+        params = comma ? comma + 1 : NULL;
+    }
+
+    name_table_insert(&macro_table, macro_count++);
+    return m;
+}
+
+// Acrescenta uma linha ao corpo da macro em definição
+static void append_macro_line(Macro *m, const char *line) {
+    macro_lines = grow_array(macro_lines, &macro_line_capacity, macro_line_count + 1, sizeof(LineSlice));
+    macro_lines[macro_line_count++] = arena_store(line, strlen(line));
+    m->line_count++;
+}
+
+// Acrescenta um trecho ao modelo da macro
+static void add_segment(Macro *m, int param, LineSlice text) {
+    macro_segments = grow_array(macro_segments, &macro_segment_capacity, macro_segment_count + 1, sizeof(TemplateSegment));
+    macro_segments[macro_segment_count].param = param;
+    macro_segments[macro_segment_count].text = text;
+    macro_segment_count++;
+    m->segment_count++;
+}
+
+// Compila o corpo da macro em um modelo de trechos literais e posições de
+// argumentos, feito uma única vez no ENDMACRO. As linhas são unidas por '\n'
+// e todo o texto literal vai para o arena em um único bloco.
+static void compile_macro(Macro *m) {
+    char *literal = NULL;
+    size_t literal_length = 0;
+    size_t literal_capacity = 0;
+    size_t run_start = 0; // Início do trecho literal corrente em 'literal'
+
+    m->first_segment = macro_segment_count;
+    m->segment_count = 0;
+
+    for (int i = 0; i < m->line_count; i++) {
+        LineSlice body = macro_lines[m->first_line + i];
+        const char *text = slice_text(body);
+        literal = grow_array(literal, &literal_capacity, literal_length + body.length + 1, 1);
+
+        for (size_t j = 0; j < body.length; j++) {
+            if (text[j] == '&' && j + 1 < body.length && is_name_char(text[j + 1])) {
+                size_t k = j + 1;
+                while (k < body.length && is_name_char(text[k])) k++;
+
+                int param = -1;
+                for (int p = 0; p < m->param_count; p++) {
+                    LineSlice name = macro_params[m->first_param + p];
+                    if (name.length == k - j - 1 && memcmp(slice_text(name), text + j + 1, name.length) == 0) {
+                        param = p;
+                        break;
+                    }
+                }
+                if (param < 0) {
+                    fprintf(stderr, "Erro: Parâmetro '%.*s' não declarado na macro '%s'\n",
+                            (int)(k - j), text + j, slice_text(m->name));
+                    exit(1);
+                }
+
+                // Fecha o trecho literal acumulado e registra a posição do argumento
+                if (literal_length > run_start) {
+                    add_segment(m, -1, (LineSlice){ run_start, literal_length - run_start });
+                }
+                add_segment(m, param, (LineSlice){ 0, 0 });
+                run_start = literal_length;
+                j = k - 1;
+                continue;
             }
+            literal[literal_length++] = text[j];
+        }
+        literal[literal_length++] = '\n';
+    }
+    if (literal_length > run_start) {
+        add_segment(m, -1, (LineSlice){ run_start, literal_length - run_start });
+    }
+
+    // Grava todo o texto literal no arena e converte os offsets
+    LineSlice stored = arena_store(literal ? literal : "", literal_length);
+    for (int s = 0; s < m->segment_count; s++) {
+        TemplateSegment *seg = &macro_segments[m->first_segment + s];
+        if (seg->param == -1) seg->text.offset += stored.offset;
+    }
+    m->literal_length = literal_length;
+    free(literal);
+}
+
+// Verifica se o valor de um CONST é um número válido (decimal ou 0x hexadecimal)
+void validate_const(const char *line) {
+    const char *colon = strchr(line, ':');
+    const char *directive = colon ? colon + 1 : line;
+    while (isspace((unsigned char)*directive)) directive++;
+    if (strncmp(directive, "CONST", 5) != 0 || (directive[5] != ' ' && directive[5] != '\0')) return;
+
+    const char *value = directive + 5;
+    while (isspace((unsigned char)*value)) value++;
+    const char *digits = (*value == '-' || *value == '+') ? value + 1 : value;
+    int base = (strncmp(digits, "0X", 2) == 0) ? 16 : 10;
+    if (base == 16) digits += 2;
 
-            // Remove espaços após a vírgula
-            char *after_comma = comma + 1;
-            while (isspace((unsigned char)*after_comma)) {
-                memmove(after_comma, after_comma + 1, strlen(after_comma));
+    char *end;
+    if (!isxdigit((unsigned char)*digits) || (strtol(digits, &end, base), *end != '\0')) {
+        fprintf(stderr, "Erro: Valor inválido em CONST: '%s'\n", value);
+        exit(1);
+    }
+}
+
+// Esvazia o buffer de saída no arquivo
+static void flush_output(FILE *output_file) {
+    fwrite(output_buffer, 1, output_length, output_file);
+    output_length = 0;
+}
+
+// Acrescenta uma linha (mais '\n') ao buffer de saída, escrevendo em blocos
+static void write_output(const char *line, size_t length, FILE *output_file) {
+    if (output_length + length + 1 > OUTPUT_BUFFER_SIZE) {
+        flush_output(output_file);
+        if (length + 1 > OUTPUT_BUFFER_SIZE) {
+            fwrite(line, 1, length, output_file);
+            putc('\n', output_file);
+            return;
+        }
+    }
+    memcpy(output_buffer + output_length, line, length);
+    output_buffer[output_length + length] = '\n';
+    output_length += length + 1;
+}
+
+// Envia uma linha para a seção correta: TEXT (e o que vier antes de
+// qualquer SECTION) vai direto para a saída; DATA fica no buffer até o fim
+void reorder_sections(const char *line, FILE *output_file) {
+    if (strncmp(line, "SECTION", 7) == 0 && (line[7] == ' ' || line[7] == '\0')) {
+        const char *section = line + 7;
+        while (isspace((unsigned char)*section)) section++;
+        if (strcmp(section, "TEXT") == 0) {
+            current_section = 1;
+            if (!text_header_written) {
+                write_output(line, strlen(line), output_file);
+                text_header_written = 1;
             }
+            return;
+        }
+        if (strcmp(section, "DATA") == 0) {
+            current_section = 2;
+            data_seen = 1;
+            return;
         }
     }
+
+    size_t length = strlen(line);
+    if (current_section == 2) {
+        data_section = grow_array(data_section, &data_capacity, data_length + length + 1, 1);
+        memcpy(data_section + data_length, line, length);
+        data_section[data_length + length] = '\n';
+        data_length += length + 1;
+    } else {
+        write_output(line, length, output_file);
+    }
 }
 
-// Verifica se a linha contém diretivas EQU ou IF, que devem ser ignoradas
-int is_equ_or_if(const char *line) {
-    if (strstr(line, "EQU") || strstr(line, "IF")) {
-        return 1; // Se for uma dessas diretivas, retorna verdadeiro
+// Junta um rótulo que está sozinho na linha à próxima instrução ou diretiva
+// e repassa o resultado para reorder_sections
+void associate_labels(const char *line, FILE *output_file) {
+    size_t length = strlen(line);
+
+    if (length > 0 && line[length - 1] == ':' && !strchr(line, ' ')) {
+        if (pending_label_length > 0) {
+            fprintf(stderr, "Erro: Dois rótulos para a mesma linha ('%.*s' e '%s')\n",
+                    (int)pending_label_length, pending_label, line);
+            exit(1);
+        }
+        pending_label = grow_array(pending_label, &pending_label_capacity, length + 1, 1);
+        memcpy(pending_label, line, length + 1);
+        pending_label_length = length;
+        return;
+    }
+
+    if (pending_label_length == 0) {
+        reorder_sections(line, output_file);
+        return;
+    }
+
+    // Um rótulo antes de uma troca de seção pertence ao fim da seção anterior
+    if (strncmp(line, "SECTION", 7) == 0) {
+        pending_label_length = 0;
+        reorder_sections(pending_label, output_file);
+        reorder_sections(line, output_file);
+        return;
+    }
+
+    join_buffer = grow_array(join_buffer, &join_capacity, pending_label_length + length + 2, 1);
+    memcpy(join_buffer, pending_label, pending_label_length);
+    join_buffer[pending_label_length] = ' ';
+    memcpy(join_buffer + pending_label_length + 1, line, length + 1);
+    pending_label_length = 0;
+    reorder_sections(join_buffer, output_file);
+}
+
+// Escreve o que ficou pendente no fim do arquivo: um rótulo sem linha
+// seguinte e a SECTION DATA guardada
+void flush_sections(FILE *output_file) {
+    if (pending_label_length > 0) {
+        pending_label_length = 0;
+        reorder_sections(pending_label, output_file);
+    }
+    flush_output(output_file);
+    if (data_seen) {
+        fprintf(output_file, "SECTION DATA\n");
+        fwrite(data_section, 1, data_length, output_file);
+    }
+}
+
+// Registra uma constante definida por EQU
+static void define_constant(const char *name, size_t length, int value) {
+    if (name_table_find(&constant_table, name, length) != -1) {
+        fprintf(stderr, "Erro: Constante '%.*s' redefinida\n", (int)length, name);
+        exit(1);
     }
-    return 0;
+    name_table_reserve(&constant_table, constant_count);
+    constants = grow_array(constants, &constant_capacity, (size_t)constant_count + 1, sizeof(EquConstant));
+    constants[constant_count].name = arena_store(name, length);
+    constants[constant_count].value = value;
+    name_table_insert(&constant_table, constant_count++);
 }
 
-// Busca uma macro pelo nome e retorna seu índice
-int find_macro(const char *name) {
-    for (int i = 0; i < macro_count; i++) {
-        if (strcmp(macros[i].name, name) == 0) {
-            return i; // Retorna o índice da macro encontrada
+// Avalia uma expressão de EQU ou IF: números (decimais ou 0x hexadecimais)
+// e constantes já definidas, unidos por + e -. O resultado é dobrado aqui
+// mesmo, em tempo de pré-processamento. 'text' deve terminar em '\0'.
+static int eval_expression(const char *text, size_t length) {
+    int result = 0;
+    int sign = 1;
+    int expect_term = 1;
+    size_t i = 0;
+
+    while (i < length) {
+        char c = text[i];
+        if (isspace((unsigned char)c)) {
+            i++;
+        } else if (expect_term && (c == '-' || c == '+')) {
+            if (c == '-') sign = -sign; // Sinal unário
+            i++;
+        } else if (expect_term && isdigit((unsigned char)c)) {
+            char *end;
+            int base = (strncmp(text + i, "0X", 2) == 0) ? 16 : 10;
+            long value = strtol(text + i, &end, base);
+            if (is_name_char(*end)) break; // Número malformado, como "5A"
+            result += sign * (int)value;
+            i = (size_t)(end - text);
+            expect_term = 0;
+        } else if (expect_term && is_name_char(c)) {
+            size_t k = i;
+            while (k < length && is_name_char(text[k])) k++;
+            int index = name_table_find(&constant_table, text + i, k - i);
+            if (index == -1) {
+                fprintf(stderr, "Erro: Constante '%.*s' não definida\n", (int)(k - i), text + i);
+                exit(1);
+            }
+            result += sign * constants[index].value;
+            i = k;
+            expect_term = 0;
+        } else if (!expect_term && (c == '+' || c == '-')) {
+            sign = (c == '-') ? -1 : 1;
+            expect_term = 1;
+            i++;
+        } else {
+            break;
         }
     }
-    return -1; // Retorna -1 se a macro não for encontrada
+
+    if (i < length || expect_term) {
+        fprintf(stderr, "Erro: Expressão inválida '%.*s'\n", (int)length, text);
+        exit(1);
+    }
+    return result;
 }
 
-// Função para processar um arquivo de entrada e gerar um arquivo pré-processado ou montado
-void preprocess_file(const char *input_filename, const char *output_filename) {
-    FILE *input_file = fopen(input_filename, "r");
-    if (!input_file) {
-        perror("Erro ao abrir o arquivo de entrada"); // Exibe mensagem de erro se o arquivo não for encontrado
+// Substitui as constantes de EQU nos operandos da linha (tudo após o
+// mnemônico). Retorna a própria linha se não houver constantes definidas.
+static char *substitute_constants(char *line, const char *operands) {
+    if (constant_count == 0) return line;
+
+    size_t length = strlen(line);
+    size_t prefix = (size_t)(operands - line);
+    subst_buffer = grow_array(subst_buffer, &subst_capacity, length + 1, 1);
+    memcpy(subst_buffer, line, prefix);
+    size_t out = prefix;
+
+    for (size_t i = prefix; i < length; ) {
+        size_t k = i;
+        if (is_name_char(line[i])) {
+            while (k < length && is_name_char(line[k])) k++;
+        } else {
+            k = i + 1;
+        }
+
+        int index = -1;
+        if (isalpha((unsigned char)line[i]) || line[i] == '_') {
+            index = name_table_find(&constant_table, line + i, k - i);
+        }
+
+        char number[16];
+        const char *piece = line + i;
+        size_t piece_length = k - i;
+        if (index != -1) {
+            piece_length = (size_t)snprintf(number, sizeof(number), "%d", constants[index].value);
+            piece = number;
+        }
+        subst_buffer = grow_array(subst_buffer, &subst_capacity, out + piece_length + (length - k) + 1, 1);
+        memcpy(subst_buffer + out, piece, piece_length);
+        out += piece_length;
+        i = k;
+    }
+    subst_buffer[out] = '\0';
+    return subst_buffer;
+}
+
+// Destino de cada linha pronta: associate_labels no modo serial, ou o
+// buffer do trecho no modo paralelo (associado depois, em ordem)
+static void output_line(const char *line, FILE *output_file) {
+    if (!chunk_output) {
+        associate_labels(line, output_file);
+        return;
+    }
+    size_t length = strlen(line);
+    chunk_output->data = grow_array(chunk_output->data, &chunk_output->capacity, chunk_output->length + length + 1, 1);
+    memcpy(chunk_output->data + chunk_output->length, line, length);
+    chunk_output->data[chunk_output->length + length] = '\n';
+    chunk_output->length += length + 1;
+}
+
+static void emit_line(char *line, int depth, FILE *output_file);
+
+// Expande uma chamada de macro. Os argumentos são trechos da linha de
+// chamada; o modelo é copiado para o buffer do nível 'depth' com um memcpy
+// por trecho e cada linha resultante passa de novo por emit_line, o que
+// permite macros chamando macros.
+static void expand_macro(Macro *m, const char **args, const size_t *arg_lengths, int depth, FILE *output_file) {
+    if (depth >= MAX_MACRO_DEPTH) {
+        fprintf(stderr, "Erro: Profundidade máxima de expansão de macros excedida em '%s'\n", slice_text(m->name));
         exit(1);
     }
 
-    FILE *output_file = fopen(output_filename, "w");
-    if (!output_file) {
-        perror("Erro ao criar o arquivo de saída"); // Exibe mensagem de erro ao tentar criar o arquivo de saída
-        fclose(input_file);
+    size_t needed = m->literal_length + 1;
+    for (int s = 0; s < m->segment_count; s++) {
+        int param = macro_segments[m->first_segment + s].param;
+        if (param >= 0) needed += arg_lengths[param];
+    }
+    expand_buffers[depth] = grow_array(expand_buffers[depth], &expand_capacities[depth], needed, 1);
+
+    char *out = expand_buffers[depth];
+    for (int s = 0; s < m->segment_count; s++) {
+        TemplateSegment *seg = &macro_segments[m->first_segment + s];
+        if (seg->param == -1) {
+            memcpy(out, slice_text(seg->text), seg->text.length);
+            out += seg->text.length;
+        } else {
+            memcpy(out, args[seg->param], arg_lengths[seg->param]);
+            out += arg_lengths[seg->param];
+        }
+    }
+    *out = '\0';
+
+    // Cada linha expandida pode ser, por sua vez, uma chamada de macro
+    char *line = expand_buffers[depth];
+    while (*line) {
+        char *nl = strchr(line, '\n');
+        *nl = '\0';
+        emit_line(line, depth + 1, output_file);
+        line = nl + 1;
+    }
+
+    // Um IF na última linha do corpo não tem o que proteger dentro da macro,
+    // e não pode descartar a linha que vem depois da chamada
+    if (skip_next_line) {
+        fprintf(stderr, "Erro: IF no fim da macro '%s' sem linha para proteger\n", slice_text(m->name));
         exit(1);
     }
+}
 
-    char line[256];
-    int inside_macro = 0; // Flag para indicar se estamos dentro de uma definição de macro
-    Macro current_macro;  // Variável para armazenar a macro que está sendo definida
+// Escreve uma linha já normalizada na saída, expandindo-a se for uma
+// chamada de macro ("[ROTULO:] NOME [ARG1, ARG2, ...]")
+static void emit_line(char *line, int depth, FILE *output_file) {
+    // Um rótulo sozinho forma uma instrução com a linha seguinte. No modo
+    // serial ele é juntado a ela aqui, antes de EQU e IF, para que
+    // "TAM:" + "EQU 3" defina TAM e um IF falso descarte o rótulo junto com a
+    // linha. O modo paralelo desiste ao ver EQU ou IF, e lá associate_labels
+    // faz a junção.
+    size_t length = strlen(line);
+    if (!chunk_output && length > 0 && line[length - 1] == ':' && !strchr(line, ' ')) {
+        if (!skip_next_line) output_line(line, output_file);
+        return;
+    }
 
-    // Lê o arquivo linha por linha
-    while (fgets(line, sizeof(line), input_file)) {
-        preprocess_line(line); // Remove espaços, comentários e converte para maiúsculas
+    // Descarta a linha protegida por um IF falso
+    if (skip_next_line) {
+        skip_next_line = 0;
+        return;
+    }
 
-        if (strlen(line) == 0) {
-            continue; // Ignora linhas vazias
+    // O rótulo guardado por associate_labels vai para o início desta linha,
+    // exceto numa troca de seção (onde ele fica no fim da seção anterior)
+    if (!chunk_output && pending_label_length > 0 && strncmp(line, "SECTION", 7) != 0) {
+        statement_buffer = grow_array(statement_buffer, &statement_capacity, pending_label_length + length + 2, 1);
+        memcpy(statement_buffer, pending_label, pending_label_length);
+        statement_buffer[pending_label_length] = ' ';
+        memcpy(statement_buffer + pending_label_length + 1, line, length + 1);
+        pending_label_length = 0;
+        line = statement_buffer;
+    }
+
+    // Pula um rótulo no início da linha
+    char *name = line;
+    char *colon = strchr(line, ':');
+    if (colon) {
+        name = colon + 1;
+        while (isspace((unsigned char)*name)) name++;
+    }
+
+    size_t name_length = 0;
+    while (name[name_length] && !isspace((unsigned char)name[name_length])) name_length++;
+
+    const char *operands = name + name_length;
+    while (isspace((unsigned char)*operands)) operands++;
+
+    // EQU e IF dependem da ordem das linhas: o modo paralelo desiste e o
+    // arquivo é refeito em série
+    if (chunk_output && ((name_length == 3 && strncmp(name, "EQU", 3) == 0) ||
+                         (name_length == 2 && strncmp(name, "IF", 2) == 0))) {
+        atomic_store(&needs_serial, 1);
+        return;
+    }
+
+    // ROTULO: EQU valor -- define uma constante e não gera linha de saída
+    if (name_length == 3 && strncmp(name, "EQU", 3) == 0) {
+        if (!colon || colon == line) {
+            fprintf(stderr, "Erro: EQU sem rótulo\n");
+            exit(1);
+        }
+        define_constant(line, (size_t)(colon - line), eval_expression(operands, strlen(operands)));
+        return;
+    }
+
+    // IF valor -- a linha seguinte só é mantida se o valor for diferente de zero
+    if (name_length == 2 && strncmp(name, "IF", 2) == 0) {
+        if (colon) {
+            *(colon + 1) = '\0';
+            output_line(line, output_file);
+        }
+        skip_next_line = (eval_expression(operands, strlen(operands)) == 0);
+        return;
+    }
+
+    // Só expande macros definidas antes da linha (no modo paralelo todas as
+    // definições já foram lidas)
+    int macro_index = name_length ? find_macro(name, name_length) : -1;
+    if (macro_index != -1 && macros[macro_index].defined_at > current_line_offset) {
+        macro_index = -1;
+    }
+    if (macro_index == -1) {
+        // Troca as constantes de EQU pelos seus valores nos operandos
+        size_t name_offset = (size_t)(name - line);
+        line = substitute_constants(line, operands);
+
+        // Corrige instruções COPY (também quando precedidas de rótulo)
+        fix_copy_instruction(line + name_offset);
+        validate_const(line);
+
+        // Se não for macro, envia a linha processada para a sua seção
+        output_line(line, output_file);
+        return;
+    }
+
+    // O rótulo da chamada vai para a primeira linha da expansão
+    if (colon) {
+        char saved = *(colon + 1);
+        *(colon + 1) = '\0';
+        output_line(line, output_file);
+        *(colon + 1) = saved;
+    }
+
+    // Separa os argumentos por vírgula
+    Macro *m = &macros[macro_index];
+    const char *args[MAX_MACRO_PARAMS];
+    size_t arg_lengths[MAX_MACRO_PARAMS];
+    int arg_count = 0;
+
+    const char *rest = name + name_length;
+    while (isspace((unsigned char)*rest)) rest++;
+    while (*rest) {
+        const char *comma = strchr(rest, ',');
+        size_t length = comma ? (size_t)(comma - rest) : strlen(rest);
+        const char *arg = rest;
+        trim_slice(&arg, &length);
+        if (arg_count >= m->param_count) {
+            arg_count = m->param_count + 1;
+            break;
         }
+        args[arg_count] = arg;
+        arg_lengths[arg_count] = length;
+        arg_count++;
+        rest = comma ? comma + 1 : rest + strlen(rest);
+    }
+    if (arg_count != m->param_count) {
+        fprintf(stderr, "Erro: Macro '%s' espera %d argumento(s)\n", slice_text(m->name), m->param_count);
+        exit(1);
+    }
+
+    expand_macro(m, args, arg_lengths, depth, output_file);
+}
+
+// Verifica se a linha [p, end) começa, após os espaços, com 'word' em
+// maiúsculas ou minúsculas -- o mesmo teste feito com strncmp sobre a
+// linha já normalizada, mas sem normalizá-la
+static int line_starts_with(const char *p, const char *end, const char *word) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    for (; *word; word++, p++) {
+        if (p >= end || toupper((unsigned char)*p) != *word) return 0;
+    }
+    return 1;
+}
 
-        if (is_equ_or_if(line)) {
-            continue; // Ignora diretivas EQU e IF
+// Como process_lines trata as definições de macro
+typedef enum {
+    PROCESS_ALL,          // Modo serial: registra as macros e emite as demais linhas
+    PROCESS_DEFINITIONS,  // Primeira varredura do modo paralelo: só registra as macros
+    PROCESS_BODY          // Trecho do modo paralelo: pula as definições e emite o resto
+} ProcessMode;
+
+// Trechos [início, fim) da entrada ocupados por definições de macro
+typedef struct {
+    size_t *bounds;       // Pares início/fim
+    size_t count;         // Número de valores em bounds (2 por definição)
+    size_t capacity;
+} BlockList;
+
+// Estado de process_lines que continua de um bloco da entrada para o
+// seguinte (uma definição de macro pode atravessar blocos)
+typedef struct {
+    size_t base;          // Posição no arquivo do início do bloco atual
+    char *line;           // Linha normalizada (cresce conforme a maior linha)
+    size_t line_capacity;
+    int inside_macro;     // Flag para indicar se estamos dentro de uma definição de macro
+    Macro *current_macro; // Macro que está sendo definida
+    size_t block_start;
+} LineState;
+
+// Processa as linhas de [p, end) -- laço principal do pré-processador.
+// 'input' é o início do bloco, na posição state->base do arquivo.
+static void process_block(LineState *state, const char *input, const char *p, const char *end,
+                          ProcessMode mode, BlockList *blocks, FILE *output_file) {
+    char *line = state->line;
+    size_t line_capacity = state->line_capacity;
+    int inside_macro = state->inside_macro;
+    Macro *current_macro = state->current_macro;
+    size_t block_start = state->block_start;
+
+    // Percorre a entrada linha por linha, sem limite de tamanho de linha
+    while (p < end) {
+        const char *comment;
+        const char *nl = scan_line(p, end, &comment);
+        const char *line_start = p;
+        current_line_offset = state->base + (size_t)(p - input);
+        p = (nl < end) ? nl + 1 : end;
+
+        // Na primeira varredura, só as linhas de definição são normalizadas
+        if (mode == PROCESS_DEFINITIONS && !inside_macro && !line_starts_with(line_start, nl, "MACRO")) {
+            continue;
+        }
+
+        // Remove espaços, comentários e converte para maiúsculas
+        size_t length = (size_t)((comment ? comment : nl) - line_start);
+        line = grow_array(line, &line_capacity, length + 1, 1);
+        length = normalize_line(line_start, length, line);
+
+        if (length == 0) {
+            continue; // Ignora linhas vazias
         }
 
         // Identifica início de uma macro
         if (strncmp(line, "MACRO", 5) == 0) {
+            if (!inside_macro) block_start = current_line_offset;
             inside_macro = 1;
-            current_macro.line_count = 0;
+            if (mode == PROCESS_BODY) continue; // Já registrada na primeira varredura
+
             char *macro_name = strtok(line + 5, " "); // Obtém o nome da macro
             if (!macro_name) {
                 fprintf(stderr, "Erro: Nome de macro ausente após 'MACRO'\n");
                 exit(1);
             }
-            strcpy(current_macro.name, macro_name); // Armazena o nome da macro
+            char *params = strtok(NULL, ""); // Parâmetros opcionais (&A, &B)
+            current_macro = begin_macro(macro_name, params); // Registra a macro na tabela
             continue;
         }
 
         // Identifica final de uma macro
         if (inside_macro && strncmp(line, "ENDMACRO", 8) == 0) {
             inside_macro = 0;
-            if (macro_count >= MAX_MACROS) {
-                fprintf(stderr, "Erro: Número máximo de macros excedido\n");
-                exit(1);
+            if (blocks) {
+                blocks->bounds = grow_array(blocks->bounds, &blocks->capacity, blocks->count + 2, sizeof(size_t));
+                blocks->bounds[blocks->count++] = block_start;
+                blocks->bounds[blocks->count++] = state->base + (size_t)(p - input);
             }
-            macros[macro_count++] = current_macro; // Armazena a macro na lista
+            if (mode == PROCESS_BODY) continue;
+
+            compile_macro(current_macro); // Gera o modelo de expansão
+            current_macro = NULL;
             continue;
         }
 
         // Se estiver dentro de uma macro, adiciona a linha ao corpo da macro
         if (inside_macro) {
-            if (current_macro.line_count >= MAX_MACRO_LINES) {
-                fprintf(stderr, "Erro: Número máximo de linhas na macro excedido\n");
-                exit(1);
-            }
-            strcpy(current_macro.lines[current_macro.line_count++], line);
+            if (mode != PROCESS_BODY) append_macro_line(current_macro, line);
             continue;
         }
 
-        // Verifica se a linha corresponde a uma macro já definida
-        int macro_index = find_macro(line);
-        if (macro_index != -1) {
-            for (int i = 0; i < macros[macro_index].line_count; i++) {
-                fprintf(output_file, "%s\n", macros[macro_index].lines[i]); // Expande a macro no arquivo de saída
-            }
-            continue;
+        // Expande a linha se for uma chamada de macro, ou a escreve como está
+        if (mode != PROCESS_DEFINITIONS) {
+            emit_line(line, 0, output_file);
+            if (mode == PROCESS_BODY && atomic_load(&needs_serial)) break;
+        }
+    }
+
+    // Definição sem ENDMACRO vai até o fim da entrada
+    if (blocks && inside_macro) {
+        blocks->bounds = grow_array(blocks->bounds, &blocks->capacity, blocks->count + 2, sizeof(size_t));
+        blocks->bounds[blocks->count++] = block_start;
+        blocks->bounds[blocks->count++] = state->base + (size_t)(end - input);
+    }
+
+    state->line = line;
+    state->line_capacity = line_capacity;
+    state->inside_macro = inside_macro;
+    state->current_macro = current_macro;
+    state->block_start = block_start;
+}
+
+// Processa a entrada inteira [p, end) de uma vez
+static void process_lines(const char *input, const char *p, const char *end, ProcessMode mode,
+                          BlockList *blocks, FILE *output_file) {
+    LineState state = { 0, NULL, 0, 0, NULL, 0 };
+    process_block(&state, input, p, end, mode, blocks, output_file);
+    free(state.line);
+}
+
+// Modo streaming, para entradas que não podem ser mapeadas (pipes, "-"):
+// lê blocos de STREAM_BLOCK_SIZE bytes e processa as linhas completas de
+// cada um, guardando só a linha incompleta do fim para o bloco seguinte.
+// A memória usada não depende do tamanho da entrada, apenas da maior linha
+// (além das macros e da SECTION DATA, que ficam em memória de qualquer forma).
+static void process_stream(int fd, FILE *output_file) {
+    LineState state = { 0, NULL, 0, 0, NULL, 0 };
+    char *buffer = NULL;
+    size_t capacity = 0, length = 0;
+
+    for (;;) {
+        buffer = grow_array(buffer, &capacity, length + STREAM_BLOCK_SIZE, 1);
+        ssize_t n = read(fd, buffer + length, capacity - length);
+        if (n < 0) {
+            perror("Erro ao ler o arquivo de entrada");
+            exit(1);
         }
+        if (n == 0) break;
 
-        // Corrige instruções COPY, se necessário
-        fix_copy_instruction(line);
+        // Só os bytes recém-lidos podem conter um novo fim de linha
+        size_t complete = length + (size_t)n;
+        while (complete > length && buffer[complete - 1] != '\n') complete--;
+        length += (size_t)n;
+        if (complete == 0 || buffer[complete - 1] != '\n') continue;
 
-        // Se não for macro, escreve a linha processada no arquivo de saída
-        fprintf(output_file, "%s\n", line);
+        process_block(&state, buffer, buffer, buffer + complete, PROCESS_ALL, NULL, output_file);
+        memmove(buffer, buffer + complete, length - complete);
+        length -= complete;
+        state.base += complete;
     }
 
-    // Fecha os arquivos após o processamento
-    fclose(input_file);
-    fclose(output_file);
+    // Última linha, sem '\n' no fim
+    process_block(&state, buffer, buffer, buffer + length, PROCESS_ALL, NULL, output_file);
+    free(buffer);
+    free(state.line);
+}
+
+// Trecho da entrada processado por uma thread no modo paralelo
+typedef struct {
+    const char *input;
+    const char *start;
+    const char *end;
+    TextBuffer output;    // Linhas prontas do trecho, separadas por '\n'
+    pthread_t thread;
+} Chunk;
+
+static void *process_chunk(void *arg) {
+    Chunk *chunk = arg;
+    chunk_output = &chunk->output;
+    process_lines(chunk->input, chunk->start, chunk->end, PROCESS_BODY, NULL, NULL);
+    chunk_output = NULL;
+    free_thread_buffers();
+    return NULL;
+}
+
+// Modo paralelo: uma primeira varredura registra todas as macros; o resto
+// da entrada é dividido em trechos alinhados por linha (nunca no meio de
+// uma definição), normalizados e expandidos em paralelo. As saídas dos
+// trechos passam, em ordem, por associate_labels, de modo que o .pre é
+// idêntico ao do modo serial. Retorna 0 se a entrada usa EQU/IF, que
+// dependem da ordem das linhas e exigem o modo serial.
+static int preprocess_chunks(const char *input, size_t input_size, int threads, const char *output_filename) {
+    BlockList blocks = { NULL, 0, 0 };
+    process_lines(input, input, input + input_size, PROCESS_DEFINITIONS, &blocks, NULL);
+
+    // Fronteiras dos trechos: início de linha fora de qualquer definição
+    Chunk chunks[MAX_THREADS];
+    size_t boundary = 0;
+    size_t next_block = 0;
+    for (int i = 0; i < threads; i++) {
+        size_t target = (size_t)((double)input_size * (i + 1) / threads);
+        size_t chunk_end = target < boundary ? boundary : target;
+        if (i == threads - 1) {
+            chunk_end = input_size;
+        } else if (chunk_end < input_size) {
+            const char *nl = memchr(input + chunk_end, '\n', input_size - chunk_end);
+            chunk_end = nl ? (size_t)(nl - input) + 1 : input_size;
+        }
+        while (next_block < blocks.count && blocks.bounds[next_block + 1] <= chunk_end) next_block += 2;
+        if (next_block < blocks.count && blocks.bounds[next_block] < chunk_end) {
+            chunk_end = blocks.bounds[next_block + 1];
+        }
+
+        chunks[i].input = input;
+        chunks[i].start = input + boundary;
+        chunks[i].end = input + chunk_end;
+        chunks[i].output = (TextBuffer){ NULL, 0, 0 };
+        boundary = chunk_end;
+    }
+    free(blocks.bounds);
+
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&chunks[i].thread, NULL, process_chunk, &chunks[i]) != 0) {
+            fprintf(stderr, "Erro: Não foi possível criar thread\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(chunks[i].thread, NULL);
+    }
+
+    if (atomic_load(&needs_serial)) {
+        for (int i = 0; i < threads; i++) free(chunks[i].output.data);
+        atomic_store(&needs_serial, 0);
+        return 0;
+    }
+
+    FILE *output_file = open_output(output_filename);
+
+    // Junta as saídas na ordem original, associando rótulos e separando seções
+    for (int i = 0; i < threads; i++) {
+        char *line = chunks[i].output.data;
+        char *limit = line + chunks[i].output.length;
+        while (line < limit) {
+            char *nl = memchr(line, '\n', (size_t)(limit - line));
+            *nl = '\0';
+            associate_labels(line, output_file);
+            line = nl + 1;
+        }
+        free(chunks[i].output.data);
+    }
+    flush_sections(output_file);
+    close_output(output_file);
+    return 1;
+}
+
+// Função para processar um arquivo de entrada e gerar um arquivo pré-processado
+void preprocess_file(const char *input_filename, const char *output_filename) {
+    preprocess_file_parallel(input_filename, output_filename, 1);
+}
+
+// Como preprocess_file, mas divide o trabalho entre 'threads' threads quando
+// a entrada é grande (0 = número de processadores). Os nomes "-" indicam a
+// entrada e a saída padrão; entradas que não são arquivos comuns são lidas
+// em modo streaming.
+void preprocess_file_parallel(const char *input_filename, const char *output_filename, int threads) {
+    int fd = open_input(input_filename);
+    const char *input;
+    size_t input_size;
+
+    if (!map_input(fd, &input, &input_size)) {
+        FILE *output_file = open_output(output_filename);
+        process_stream(fd, output_file);
+        flush_sections(output_file);
+        if (fd != STDIN_FILENO) close(fd);
+        close_output(output_file);
+        free_preprocessor_state();
+        return;
+    }
+    if (fd != STDIN_FILENO) close(fd);
+
+    if (threads <= 0) threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads > MAX_THREADS) threads = MAX_THREADS;
+
+    if (threads > 1 && input_size >= PARALLEL_MIN_SIZE) {
+        int done = preprocess_chunks(input, input_size, threads, output_filename);
+        free_preprocessor_state();
+        if (done) {
+            unmap_input(input, input_size);
+            return;
+        }
+    }
+
+    FILE *output_file = open_output(output_filename);
+
+    process_lines(input, input, input + input_size, PROCESS_ALL, NULL, output_file);
+    flush_sections(output_file);
+
+    // Fecha os arquivos e descarta as macros após o processamento
+    unmap_input(input, input_size);
+    close_output(output_file);
+    free_preprocessor_state();
 }
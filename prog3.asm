@@ -0,0 +1,22 @@
+;=============================================
+; prog3.asm: soma de um vetor com EQU e ROTULO+N
+;=============================================
+TAM: EQU 3
+ANTES: EQU -1
+
+SECTION TEXT
+    LOAD VET            ; VET[0]
+    ADD VET + 1         ; VET[1]
+    ADD VET+TAM-1       ; VET[2]
+    STORE SOMA
+    OUTPUT SOMA
+    COPY FIM+ANTES, VET ; EQU negativo: FIM+-1 é VET[2]
+    OUTPUT VET
+    STOP
+
+SECTION DATA
+VET: CONST 4
+     CONST 5
+     CONST 6
+FIM: SPACE
+SOMA: SPACE
@@ -0,0 +1,1471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define MAX_MEMORY   65536   // Palavras de memória da máquina simulada
+#define MAX_PROGRAMS 16      // Programas carregados na mesma memória
+#define MAX_SHARED   8       // Módulos compartilhados carregados
+#define MAX_SYM      200     // Definições exportadas / entradas de indireção por imagem
+#define PAGE_SHIFT   8       // Páginas de 256 palavras no ponto de restauração
+#define PAGE_WORDS   (1 << PAGE_SHIFT)
+#define PAGE_COUNT   (MAX_MEMORY / PAGE_WORDS)
+#define CHECKPOINT_MAGIC "SBCKPT1"
+#define IO_BLOCK_SIZE (1 << 16) // Bytes por chamada de sistema na entrada e na saída
+#define INPUT_BATCH  4096    // Inteiros convertidos de uma vez para INPUT
+#define MAX_FUSED_WORDS 6    // Palavras da maior superinstrução
+
+// Estado da máquina simulada
+typedef struct {
+    int pc;                  // Contador de programa
+    int acc;                 // Acumulador
+    int memory[MAX_MEMORY + 2]; // Memória de palavras (+2: operandos lidos após a última)
+} Machine;
+
+// Definição exportada por um módulo compartilhado
+typedef struct {
+    char symbol[50];
+    int  address;            // Relativo ao início do módulo
+} Export;
+
+// Entrada da tabela de indireção de um executável
+typedef struct {
+    char symbol[50];
+    int  addend;             // Deslocamento (SIMBOLO+N)
+    int  lib;                // Índice em 'needed' do módulo que define o símbolo
+    int  address;            // Endereço absoluto, depois de ligado
+    int  bound;
+} Import;
+
+// Imagem carregada: programa ou módulo compartilhado
+typedef struct {
+    char name[256];
+    int  kind;               // 0 = absoluto, 'E' = relocável, 'S' = compartilhado
+    int  base;               // Endereço da primeira palavra (e de início da execução)
+    int  size;               // Quantidade de palavras
+    uint32_t *bitmap;        // Bits de relocação (só durante a carga)
+
+    Export exports[MAX_SYM]; // Tabela de definições ('S')
+    int    export_count;
+
+    char   needed[MAX_SHARED][256]; // Módulos compartilhados usados ('E')
+    int    needed_count;
+    Import imports[MAX_SYM]; // Tabela de indireção ('E')
+    int    import_count;
+} Image;
+
+// Declarações das funções principais
+void read_header(FILE *fp, const char *filename, Image *img);
+void read_code(FILE *fp, Machine *m, Image *img);
+void load_executable(Machine *m, const char *filename, int base, Image *prog);
+Image *load_shared(Machine *m, const char *filename);
+int  bind_import(Machine *m, Image *prog, int index);
+void relocate_image(int *words, const uint32_t *bitmap, int size, int base);
+void run_program(Machine *m, Image *prog);
+void error_exit(const char *msg);
+
+static Image programs[MAX_PROGRAMS];     // Programas, na ordem de execução
+static int   program_count = 0;
+static int   program_end = 0;            // Primeira palavra livre após os programas
+
+static Image shared_modules[MAX_SHARED]; // Carregados uma vez e reaproveitados
+static int   shared_count = 0;
+static int   shared_start = MAX_MEMORY;  // Módulos compartilhados ocupam o topo da memória
+
+static Image *running = NULL;            // Programa em execução (dono da tabela de indireção)
+
+static unsigned long *profile_counts = NULL; // -p: execuções de cada endereço
+static unsigned long long executed = 0;      // Instruções executadas
+
+// Ponto de restauração (-c/-C/-r): só as páginas escritas desde a carga dos
+// programas são gravadas, junto com PC, ACC e a posição na entrada
+typedef struct {
+    char     magic[8];                     // CHECKPOINT_MAGIC
+    uint32_t page_words;                   // Palavras por página (PAGE_WORDS)
+    uint32_t page_count;                   // Páginas gravadas
+    uint32_t program_count;                // Programas carregados
+    uint32_t program;                      // Programa em execução
+    int32_t  pc, acc;
+    uint64_t executed;                     // Instruções executadas até aqui
+    uint64_t input_values;                 // Inteiros lidos por INPUT
+    int64_t  input_offset;                 // Posição na entrada padrão (-1 se não é arquivo)
+    uint64_t image_hash;                   // Hash da memória logo após a carga
+    int32_t  program_base[MAX_PROGRAMS];
+    int32_t  program_size[MAX_PROGRAMS];
+    uint32_t shared_count;                 // Módulos compartilhados, na ordem de carga
+    char     shared[MAX_SHARED][256];
+} CheckpointHeader;
+// Seguem page_count índices de página (uint32_t) e as páginas (int32_t cada palavra)
+
+static unsigned char dirty_pages[PAGE_COUNT];     // Páginas escritas durante a execução
+static const char *checkpoint_file = NULL;        // -c: arquivo do ponto de restauração
+static unsigned long long checkpoint_interval = 0; // -C: instruções entre gravações
+static unsigned long long checkpoint_next = ~0ULL; // Próxima gravação periódica
+static unsigned long long checkpoint_at = ~0ULL;  // Próxima verificação (gravação ou sinal)
+static volatile sig_atomic_t checkpoint_signal = 0; // 1 = SIGUSR1, 2 = SIGINT/SIGTERM
+static unsigned long long input_values = 0;       // Inteiros lidos por INPUT
+static int64_t input_offset = -1;                 // Byte após o último inteiro lido (-1 se não é arquivo)
+static uint64_t image_hash = 0;
+static int current_program = 0;
+static const Machine *input_machine = NULL;       // Máquina parada em INPUT à espera da entrada
+
+#define SIGNAL_POLL  65536   // Instruções entre verificações de sinal com -c
+#define MARK_DIRTY(addr) (dirty_pages[(addr) >> PAGE_SHIFT] = 1)
+
+// Canal de entrada de INPUT: a entrada padrão é mapeada em memória (se for um
+// arquivo) ou lida em blocos de IO_BLOCK_SIZE, e convertida em lotes de
+// INPUT_BATCH inteiros; INPUT só copia o próximo valor do lote
+typedef struct {
+    int binary;                    // Inteiros de 32 bits em vez de texto
+    int mapped;                    // A entrada padrão é um arquivo mapeado
+    int eof;                       // Não há mais bytes para ler
+    const unsigned char *data;     // Bytes ainda não convertidos: data[pos..length)
+    size_t pos, length;
+    int64_t data_offset;           // Posição na entrada de data[0] (-1 se não é arquivo)
+    unsigned char *block;          // Bloco de leitura (entrada que não é arquivo)
+    int values[INPUT_BATCH];       // Lote convertido
+    int64_t ends[INPUT_BATCH];     // Posição após cada valor do lote
+    int count, next;
+} InputChannel;
+
+// Canal de saída de OUTPUT: os valores são formatados num buffer, escrito
+// com uma única chamada write quando enche, antes de esperar por entrada de
+// um pipe ou terminal, num ponto de restauração e no fim da execução
+typedef struct {
+    int binary;
+    size_t length;
+    char buffer[IO_BLOCK_SIZE];
+} OutputChannel;
+
+static InputChannel  input;
+static OutputChannel output;
+
+void setup_io(int binary_input, int binary_output);
+int  refill_input(void);
+void skip_input(uint64_t values, int64_t offset);
+void flush_output(void);
+
+// Próximo inteiro da entrada; devolve 0 no fim
+static inline int read_input(int *value)
+{
+    if(input.next == input.count && !refill_input()) return 0;
+    input_offset = input.ends[input.next];
+    *value = input.values[input.next++];
+    input_values++;
+    return 1;
+}
+
+// Acrescenta um inteiro à saída, em texto (um por linha) ou binário
+static inline void write_output(int value)
+{
+    if(output.length + 12 > sizeof(output.buffer)) flush_output();
+    char *p = output.buffer + output.length;
+    if(output.binary) {
+        memcpy(p, &value, sizeof(int));
+        output.length += sizeof(int);
+        return;
+    }
+    char digits[12];
+    int n = 0;
+    unsigned magnitude = value < 0 ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while(magnitude);
+    if(value < 0) *p++ = '-';
+    while(n > 0) *p++ = digits[--n];
+    *p++ = '\n';
+    output.length = (size_t)(p - output.buffer);
+}
+
+// Operações do pré-decodificador: os opcodes da máquina (os mesmos de
+// opcodes[] no montador) seguidos das superinstruções, que executam uma
+// sequência comum de instruções num único despacho
+enum {
+    OP_UNDECODED = 0,
+    OP_ADD, OP_SUB, OP_MULT, OP_DIV, OP_JMP, OP_JMPN, OP_JMPP, OP_JMPZ,
+    OP_COPY, OP_LOAD, OP_STORE, OP_INPUT, OP_OUTPUT, OP_STOP,
+    OP_LOAD_ADD_STORE, OP_LOAD_SUB_STORE,
+    OP_LOAD_SUB_JMPZ, OP_LOAD_SUB_JMPN, OP_LOAD_SUB_JMPP,
+    OP_LOAD_ADD, OP_LOAD_SUB, OP_LOAD_STORE, OP_ADD_STORE, OP_SUB_STORE,
+    OP_LOAD_JMPZ, OP_LOAD_JMPN, OP_LOAD_JMPP,
+    OP_GENERIC               // Operando ainda não ligado ou inválido: resolvido ao executar
+};
+
+// Instrução (ou superinstrução) pré-decodificada, indexada pelo endereço
+typedef struct {
+    uint8_t op;              // OP_* (OP_UNDECODED até a primeira execução)
+    uint8_t words;           // Palavras de memória cobertas
+    uint8_t count;           // Instruções da máquina executadas
+    int a, b, c;             // Operandos, já como endereços
+} Decoded;
+
+// Tabela estática de superinstruções, das mais longas para as mais curtas.
+// Só a última instrução de cada sequência escreve na memória ou salta.
+typedef struct {
+    const char *name;
+    uint8_t ops[3];
+    uint8_t length;
+    uint8_t op;
+} Superinstruction;
+
+static const Superinstruction superinstructions[] = {
+    {"LOAD ADD STORE", {OP_LOAD, OP_ADD, OP_STORE}, 3, OP_LOAD_ADD_STORE},
+    {"LOAD SUB STORE", {OP_LOAD, OP_SUB, OP_STORE}, 3, OP_LOAD_SUB_STORE},
+    {"LOAD SUB JMPZ",  {OP_LOAD, OP_SUB, OP_JMPZ},  3, OP_LOAD_SUB_JMPZ},
+    {"LOAD SUB JMPN",  {OP_LOAD, OP_SUB, OP_JMPN},  3, OP_LOAD_SUB_JMPN},
+    {"LOAD SUB JMPP",  {OP_LOAD, OP_SUB, OP_JMPP},  3, OP_LOAD_SUB_JMPP},
+    {"LOAD ADD",       {OP_LOAD, OP_ADD},           2, OP_LOAD_ADD},
+    {"LOAD SUB",       {OP_LOAD, OP_SUB},           2, OP_LOAD_SUB},
+    {"LOAD STORE",     {OP_LOAD, OP_STORE},         2, OP_LOAD_STORE},
+    {"ADD STORE",      {OP_ADD, OP_STORE},          2, OP_ADD_STORE},
+    {"SUB STORE",      {OP_SUB, OP_STORE},          2, OP_SUB_STORE},
+    {"LOAD JMPZ",      {OP_LOAD, OP_JMPZ},          2, OP_LOAD_JMPZ},
+    {"LOAD JMPN",      {OP_LOAD, OP_JMPN},          2, OP_LOAD_JMPN},
+    {"LOAD JMPP",      {OP_LOAD, OP_JMPP},          2, OP_LOAD_JMPP},
+};
+#define SUPER_COUNT ((int)(sizeof(superinstructions) / sizeof(superinstructions[0])))
+
+static Decoded decoded[MAX_MEMORY];
+static unsigned char code_word[MAX_MEMORY];   // Palavra coberta por uma instrução decodificada
+static unsigned char jump_target[MAX_MEMORY]; // Destino de salto: nunca fica no meio de uma superinstrução
+static unsigned char fusion_plan[MAX_MEMORY]; // -F: superinstrução escolhida em cada endereço (índice + 1)
+static int fusion_enabled = 1;                // -n desliga as superinstruções
+static int fusion_planned = 0;                // -F: só funde onde o perfil escolheu
+static unsigned long long dispatches = 0;     // Despachos do laço de execução
+static unsigned long super_sites[SUPER_COUNT]; // Superinstruções decodificadas, por tipo
+
+void scan_jump_targets(const int *memory, int base, int size);
+void decode_at(const int *memory, int pc);
+void invalidate_code(int addr);
+void plan_fusion(const int *memory, const Image *prog, const char *filename);
+
+// Escrita de dados na memória: marca a página para o ponto de restauração e
+// descarta a pré-decodificação das instruções que cobrem a palavra
+static inline void store_word(int *memory, int addr, int value)
+{
+    memory[addr] = value;
+    MARK_DIRTY(addr);
+    if(code_word[addr]) invalidate_code(addr);
+}
+
+void write_profile(const char *filename, const Image *prog);
+uint64_t hash_memory(const Machine *m, int size);
+void write_checkpoint(const Machine *m, const char *filename);
+void restore_checkpoint(Machine *m, const char *filename, int skip);
+void resume_program(Machine *m, Image *prog);
+static void checkpoint_handler(int sig);
+void schedule_checkpoint(void);
+void checkpoint_stop(const Machine *m);
+void checkpoint_input_wait(void);
+
+// Função principal
+// Uso: simulador [-b base] [-p perfil] [-v] [-n] [-F perfil] [-I formato] [-O formato]
+//                 [-c ponto [-C n]] [-r ponto [-s]] programa.e [programa2.e ...]
+// Os programas são carregados um após o outro na mesma memória, a partir de
+// 'base' (padrão 0), e executados em sequência. Só executáveis relocáveis
+// (ligador -r) podem ser carregados fora do endereço 0. Módulos
+// compartilhados usados pelos programas são carregados no topo da memória
+// quando um de seus símbolos é usado pela primeira vez.
+// -p grava quantas vezes cada endereço do programa foi executado (perfil
+// para ligador -p) e -v mostra em stderr as instruções executadas e o tempo.
+// O pré-decodificador funde sequências comuns em superinstruções (-n
+// desliga); com -F perfil (gerado por -p) só as sequências executadas são
+// fundidas, escolhidas pela economia de despachos.
+// -I binario / -O binario trocam o texto da entrada / saída padrão por
+// inteiros de 32 bits na ordem de bytes da máquina.
+// -c grava o estado da máquina no arquivo a cada -C instruções, ao receber
+// SIGUSR1 e ao ser interrompida (SIGINT/SIGTERM); -r retoma a execução de um
+// ponto gravado com os mesmos programas, pulando a entrada já lida (com -s,
+// a entrada padrão contém só o restante).
+int main(int argc, char *argv[])
+{
+    static Machine machine;
+    const char *profile_file = NULL;
+    const char *restore_file = NULL;
+    const char *fusion_file = NULL;
+    int verbose = 0;
+    int suffix_input = 0;
+    int binary_input = 0, binary_output = 0;
+
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            profile_file = argv[++i];
+        } else if(strcmp(argv[i], "-v") == 0) {
+            verbose = 1;
+        } else if(strcmp(argv[i], "-n") == 0) {
+            fusion_enabled = 0;
+        } else if(strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+            fusion_file = argv[++i];
+        } else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            checkpoint_file = argv[++i];
+        } else if(strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+            checkpoint_interval = strtoull(argv[++i], NULL, 10);
+        } else if(strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            restore_file = argv[++i];
+        } else if(strcmp(argv[i], "-s") == 0) {
+            suffix_input = 1;
+        } else if((strcmp(argv[i], "-I") == 0 || strcmp(argv[i], "-O") == 0) && i + 1 < argc) {
+            int binary = strcmp(argv[i + 1], "binario") == 0;
+            if(!binary && strcmp(argv[i + 1], "texto") != 0) {
+                error_exit("Formato de entrada/saída inválido (use texto ou binario).");
+            }
+            if(argv[i][1] == 'I') binary_input = binary;
+            else binary_output = binary;
+            i++;
+        } else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            program_end = atoi(argv[++i]);
+            if(program_end < 0 || program_end >= MAX_MEMORY) {
+                error_exit("Endereço base fora da memória.");
+            }
+        } else if(argv[i][0] == '-') {
+            program_count = 0;
+            break;
+        } else {
+            if(program_count >= MAX_PROGRAMS) {
+                error_exit("Programas demais para uma execução.");
+            }
+            Image *prog = &programs[program_count++];
+            load_executable(&machine, argv[i], program_end, prog);
+            program_end += prog->size;
+        }
+    }
+
+    if(program_count == 0) {
+        fprintf(stderr, "Uso: %s [-b base] [-p perfil] [-v] [-n] [-F perfil] [-I formato] [-O formato]\n"
+                        "       [-c ponto [-C n]] [-r ponto [-s]] programa.e [programa2.e ...]\n", argv[0]);
+        exit(1);
+    }
+    if(checkpoint_interval && !checkpoint_file) error_exit("-C requer o arquivo do ponto de restauração (-c).");
+    if(suffix_input && !restore_file) error_exit("-s só pode ser usado com -r.");
+    if(profile_file) {
+        if(program_count > 1) error_exit("O perfil (-p) é gerado para um único programa.");
+        profile_counts = calloc(MAX_MEMORY, sizeof(unsigned long));
+        if(!profile_counts) error_exit("Memória insuficiente.");
+        // O perfil conta cada instrução, então nada é fundido
+        fusion_enabled = 0;
+    }
+    if(fusion_file && fusion_enabled) {
+        if(program_count > 1) error_exit("O perfil de -F vale para um único programa.");
+        plan_fusion(machine.memory, &programs[0], fusion_file);
+    }
+
+    setup_io(binary_input, binary_output);
+
+    // A memória logo após a carga é a base das páginas gravadas
+    image_hash = hash_memory(&machine, program_end);
+    if(checkpoint_file) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = checkpoint_handler;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGUSR1, &sa, NULL);
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+    }
+
+    int first = 0;
+    if(restore_file) {
+        restore_checkpoint(&machine, restore_file, !suffix_input);
+        first = current_program;
+    }
+    schedule_checkpoint();
+
+    unsigned long long executed_before = executed;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = first; i < program_count; i++) {
+        current_program = i;
+        if(restore_file && i == first) {
+            resume_program(&machine, &programs[i]);
+        } else {
+            run_program(&machine, &programs[i]);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    flush_output();
+    if(verbose) {
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        unsigned long long count = executed - executed_before;
+        fprintf(stderr, "Instruções executadas: %llu em %.3f s (%.1f MIPS)\n",
+                count, seconds, seconds > 0 ? count / seconds / 1e6 : 0.0);
+        fprintf(stderr, "Despachos: %llu (%.1f%% a menos que instruções)\n",
+                dispatches, count ? 100.0 * (double)(count - dispatches) / count : 0.0);
+        for(int i = 0; i < SUPER_COUNT; i++) {
+            if(super_sites[i]) fprintf(stderr, "  %-15s %lu\n", superinstructions[i].name, super_sites[i]);
+        }
+    }
+    if(profile_file) {
+        write_profile(profile_file, &programs[0]);
+    }
+    return 0;
+}
+
+// SIGUSR1 pede uma gravação; SIGINT/SIGTERM pedem gravação e término.
+// A gravação é feita pelo laço de execução, entre duas instruções.
+static void checkpoint_handler(int sig)
+{
+    checkpoint_signal = (sig == SIGUSR1) ? 1 : 2;
+}
+
+// Parada do laço de execução marcada por checkpoint_at: grava o ponto de
+// restauração se chegou a hora ou se um sinal pediu. Fica fora do laço
+// (noinline) para não pesar na execução das instruções.
+__attribute__((noinline)) void checkpoint_stop(const Machine *m)
+{
+    int request = checkpoint_signal;
+    if(request || executed >= checkpoint_next) {
+        checkpoint_signal = 0;
+        write_checkpoint(m, checkpoint_file);
+        if(request == 2) {
+            fprintf(stderr, "Execução interrompida; estado gravado em %s.\n", checkpoint_file);
+            exit(1);
+        }
+        if(checkpoint_interval) checkpoint_next = executed + checkpoint_interval;
+    }
+    schedule_checkpoint();
+}
+
+// Um sinal interrompeu a espera pela entrada de INPUT: o pedido é atendido
+// ali mesmo, com o estado de antes da instrução, em vez de esperar o próximo
+// valor chegar (com SIGINT, poderia não chegar nunca)
+void checkpoint_input_wait(void)
+{
+    if(checkpoint_signal && checkpoint_file && input_machine) checkpoint_stop(input_machine);
+}
+
+// Próxima parada do laço de execução: a gravação periódica ou, com -c, a
+// próxima verificação de sinal, o que vier antes
+void schedule_checkpoint(void)
+{
+    if(!checkpoint_file) return;
+    if(checkpoint_interval && checkpoint_next == ~0ULL) checkpoint_next = executed + checkpoint_interval;
+    checkpoint_at = executed + SIGNAL_POLL;
+    if(checkpoint_next < checkpoint_at) checkpoint_at = checkpoint_next;
+}
+
+// Hash FNV-1a das primeiras 'size' palavras da memória, para conferir na
+// restauração que os mesmos programas foram carregados
+uint64_t hash_memory(const Machine *m, int size)
+{
+    uint64_t hash = 1469598103934665603ULL;
+    for(int i = 0; i < size; i++) {
+        hash ^= (uint32_t)m->memory[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Grava o estado da máquina: cabeçalho, índices das páginas sujas e as
+// páginas. O arquivo é escrito ao lado e renomeado, então uma interrupção
+// durante a gravação não estraga o ponto anterior.
+void write_checkpoint(const Machine *m, const char *filename)
+{
+    static CheckpointHeader header;
+    static uint32_t pages[PAGE_COUNT];
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.page_words    = PAGE_WORDS;
+    header.program_count = program_count;
+    header.program       = current_program;
+    header.pc            = m->pc;
+    header.acc           = m->acc;
+    header.executed      = executed;
+    header.input_values  = input_values;
+    header.input_offset  = input_offset;
+    header.image_hash    = image_hash;
+    for(int i = 0; i < program_count; i++) {
+        header.program_base[i] = programs[i].base;
+        header.program_size[i] = programs[i].size;
+    }
+    header.shared_count = shared_count;
+    for(int i = 0; i < shared_count; i++) {
+        memcpy(header.shared[i], shared_modules[i].name, sizeof(header.shared[i]));
+    }
+    for(int p = 0; p < PAGE_COUNT; p++) {
+        if(dirty_pages[p]) pages[header.page_count++] = p;
+    }
+
+    // A saída já produzida não é repetida na restauração
+    flush_output();
+
+    char temp[4096];
+    snprintf(temp, sizeof(temp), "%s.tmp", filename);
+    FILE *out = fopen(temp, "wb");
+    if(!out) {
+        perror("Erro ao criar o ponto de restauração");
+        exit(1);
+    }
+    int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fwrite(pages, sizeof(uint32_t), header.page_count, out) == header.page_count;
+    for(uint32_t i = 0; ok && i < header.page_count; i++) {
+        ok = fwrite(&m->memory[pages[i] * PAGE_WORDS], sizeof(int), PAGE_WORDS, out) == PAGE_WORDS;
+    }
+    if(fclose(out) != 0 || !ok || rename(temp, filename) != 0) {
+        perror("Erro ao gravar o ponto de restauração");
+        exit(1);
+    }
+}
+
+// Retoma um ponto gravado por write_checkpoint. Os programas já foram
+// carregados pela linha de comando; o arquivo é mapeado em memória e só as
+// páginas gravadas são copiadas por cima da imagem carregada.
+void restore_checkpoint(Machine *m, const char *filename, int skip)
+{
+    int fd = open(filename, O_RDONLY);
+    struct stat st;
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Erro ao abrir o ponto de restauração %s\n", filename);
+        exit(1);
+    }
+    if((size_t)st.st_size < sizeof(CheckpointHeader)) {
+        fprintf(stderr, "Erro: %s não é um ponto de restauração.\n", filename);
+        exit(1);
+    }
+    const unsigned char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        perror("Erro ao mapear o ponto de restauração");
+        exit(1);
+    }
+
+    const CheckpointHeader *header = (const CheckpointHeader *)data;
+    if(memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(header->magic)) != 0 ||
+       header->page_words != PAGE_WORDS || header->page_count > PAGE_COUNT ||
+       (size_t)st.st_size != sizeof(CheckpointHeader) +
+           header->page_count * (sizeof(uint32_t) + PAGE_WORDS * sizeof(int)) ||
+       header->shared_count > MAX_SHARED || header->program >= header->program_count) {
+        fprintf(stderr, "Erro: %s não é um ponto de restauração válido.\n", filename);
+        exit(1);
+    }
+
+    // Os mesmos programas, nos mesmos endereços
+    int same = (int)header->program_count == program_count && header->image_hash == image_hash;
+    for(int i = 0; same && i < program_count; i++) {
+        same = header->program_base[i] == programs[i].base && header->program_size[i] == programs[i].size;
+    }
+    if(!same) {
+        fprintf(stderr, "Erro: %s foi gravado com outros programas ou outro endereço base.\n", filename);
+        exit(1);
+    }
+
+    // Módulos compartilhados na mesma ordem, para que fiquem nos mesmos endereços
+    for(uint32_t i = 0; i < header->shared_count; i++) {
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)sizeof(header->shared[i]) - 1, header->shared[i]);
+        load_shared(m, name);
+    }
+
+    const uint32_t *pages = (const uint32_t *)(data + sizeof(CheckpointHeader));
+    const unsigned char *words = (const unsigned char *)(pages + header->page_count);
+    for(uint32_t i = 0; i < header->page_count; i++) {
+        if(pages[i] >= PAGE_COUNT) {
+            fprintf(stderr, "Erro: página inválida em %s.\n", filename);
+            exit(1);
+        }
+        memcpy(&m->memory[pages[i] * PAGE_WORDS], words + (size_t)i * PAGE_WORDS * sizeof(int),
+               PAGE_WORDS * sizeof(int));
+        dirty_pages[pages[i]] = 1;
+    }
+
+    m->pc = header->pc;
+    m->acc = header->acc;
+    executed = header->executed;
+    current_program = header->program;
+
+    // Entrada já lida; com -s a entrada padrão contém só o restante
+    if(skip) skip_input(header->input_values, header->input_offset);
+    munmap((void *)data, st.st_size);
+}
+
+// Prepara os canais de entrada e saída. Uma entrada padrão que é arquivo
+// comum é mapeada inteira; pipes e terminais são lidos em blocos.
+void setup_io(int binary_input, int binary_output)
+{
+    input.binary = binary_input;
+    output.binary = binary_output;
+    output.length = 0;
+    atexit(flush_output);
+
+    struct stat st;
+    if(fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+        off_t start = lseek(STDIN_FILENO, 0, SEEK_CUR);
+        input.mapped = 1;
+        input.eof = 1;
+        input.data_offset = 0;
+        input.length = (size_t)st.st_size;
+        input.pos = start > 0 ? (size_t)start : 0;
+        if(input.pos > input.length) input.pos = input.length;
+        if(st.st_size > 0) {
+            input.data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, STDIN_FILENO, 0);
+            if(input.data == MAP_FAILED) {
+                perror("Erro ao mapear a entrada padrão");
+                exit(1);
+            }
+        }
+        input_offset = (int64_t)input.pos;
+    } else {
+        // O bloco guarda no início o número que ficou incompleto no read anterior
+        input.block = malloc(IO_BLOCK_SIZE + 32);
+        if(!input.block) error_exit("Memória insuficiente.");
+        input.data = input.block;
+        input.data_offset = -1;
+    }
+}
+
+// Lê mais um bloco da entrada padrão, mantendo no início os bytes ainda não
+// convertidos (no máximo um número incompleto). Devolve 0 no fim da entrada.
+static int read_block(void)
+{
+    if(input.eof) return 0;
+    size_t rest = input.length - input.pos;
+    if(rest > 32) error_exit("ERRO: Valor grande demais na entrada.");
+    memmove(input.block, input.block + input.pos, rest);
+    input.pos = 0;
+    input.length = rest;
+
+    // Quem espera a nossa saída antes de mandar mais entrada precisa recebê-la
+    flush_output();
+
+    // Um sinal de -c interrompe a espera: o pedido é atendido antes de voltar
+    // a ler (SIGINT/SIGTERM gravam e terminam aqui)
+    ssize_t n;
+    for(;;) {
+        n = read(STDIN_FILENO, input.block + rest, IO_BLOCK_SIZE);
+        if(n >= 0 || errno != EINTR) break;
+        checkpoint_input_wait();
+    }
+    if(n < 0) {
+        perror("Erro ao ler a entrada padrão");
+        exit(1);
+    }
+    if(n == 0) {
+        input.eof = 1;
+        return 0;
+    }
+    input.length += (size_t)n;
+    return 1;
+}
+
+static void invalid_input(const unsigned char *token, size_t length)
+{
+    flush_output();
+    fprintf(stderr, "ERRO: Valor inválido na entrada: '%.*s'.\n", (int)length, (const char *)token);
+    exit(1);
+}
+
+// Converte o próximo lote de inteiros. Na entrada lida por blocos o lote
+// termina no fim do bloco, para não esperar por entrada que ainda não é
+// necessária (um terminal, por exemplo). Devolve 0 no fim da entrada.
+int refill_input(void)
+{
+    input.count = input.next = 0;
+
+    while(input.count < INPUT_BATCH) {
+        const unsigned char *data = input.data;
+        size_t pos = input.pos, length = input.length;
+
+        if(input.binary) {
+            size_t available = (length - pos) / sizeof(int);
+            if(available == 0) {
+                if(input.count > 0 || !read_block()) break;
+                continue;
+            }
+            if(available > (size_t)(INPUT_BATCH - input.count)) available = INPUT_BATCH - input.count;
+            memcpy(&input.values[input.count], data + pos, available * sizeof(int));
+            for(size_t i = 0; i < available; i++) {
+                pos += sizeof(int);
+                input.ends[input.count++] = input.data_offset < 0 ? -1 : input.data_offset + (int64_t)pos;
+            }
+            input.pos = pos;
+            continue;
+        }
+
+        while(pos < length && (data[pos] == ' ' || data[pos] == '\n' || data[pos] == '\t' ||
+                               data[pos] == '\r' || data[pos] == '\v' || data[pos] == '\f')) pos++;
+        input.pos = pos;
+
+        // Um número que chega ao fim do bloco pode continuar no próximo
+        size_t end = pos;
+        while(end < length && data[end] > ' ') end++;
+        if(end == length && !input.eof) {
+            if(input.count > 0 || !read_block()) {
+                if(input.count > 0 || pos == end) break;
+            }
+            continue;
+        }
+        if(pos == end) break;
+
+        // Um valor inválido só é erro quando INPUT chega nele
+        size_t i = pos;
+        int negative = 0;
+        if(data[i] == '-' || data[i] == '+') negative = (data[i++] == '-');
+        unsigned value = 0;
+        int valid = (i < end);
+        for(; i < end && valid; i++) {
+            valid = (data[i] >= '0' && data[i] <= '9');
+            value = value * 10 + (unsigned)(data[i] - '0');
+        }
+        if(!valid) {
+            if(input.count > 0) break;
+            invalid_input(data + pos, end - pos);
+        }
+        input.values[input.count] = (int)(negative ? 0u - value : value);
+        input.ends[input.count++] = input.data_offset < 0 ? -1 : input.data_offset + (int64_t)end;
+        input.pos = end;
+    }
+    return input.count > 0;
+}
+
+// Pula a entrada já lida antes de um ponto de restauração: num arquivo volta
+// direto à posição gravada; senão descarta os inteiros já lidos
+void skip_input(uint64_t values, int64_t offset)
+{
+    if(input.mapped && offset >= 0 && (size_t)offset <= input.length) {
+        input.pos = (size_t)offset;
+        input.count = input.next = 0;
+        input_offset = offset;
+        input_values = values;
+        return;
+    }
+    for(uint64_t i = 0; i < values; i++) {
+        int value;
+        if(!read_input(&value)) {
+            fprintf(stderr, "Erro: a entrada tem menos valores que os %llu já lidos.\n",
+                    (unsigned long long)values);
+            exit(1);
+        }
+    }
+}
+
+// Escreve a saída acumulada com write, sem passar pelo stdio
+void flush_output(void)
+{
+    size_t written = 0;
+    while(written < output.length) {
+        ssize_t n = write(STDOUT_FILENO, output.buffer + written, output.length - written);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) {
+            output.length = 0;
+            perror("Erro ao escrever a saída");
+            exit(1);
+        }
+        written += (size_t)n;
+    }
+    output.length = 0;
+}
+
+// Grava o perfil: "ENDERECO CONTAGEM" para cada endereço executado do
+// programa, relativo ao seu início (o formato lido por ligador -p)
+void write_profile(const char *filename, const Image *prog)
+{
+    FILE *out = fopen(filename, "w");
+    if(!out) {
+        perror("Erro ao criar o arquivo de perfil");
+        exit(1);
+    }
+    for(int i = 0; i < prog->size; i++) {
+        if(profile_counts[prog->base + i] > 0) {
+            fprintf(out, "%d %lu\n", i, profile_counts[prog->base + i]);
+        }
+    }
+    fclose(out);
+}
+
+// Lê o cabeçalho de uma imagem, até a linha de código
+// Formatos aceitos:
+//   10 7 1 17 ...             executável absoluto (só roda no endereço 0)
+//
+//   E, TAMANHO                executável relocável (ligador -r):
+//   N, modulo.sm              módulos compartilhados usados (ligador -l)
+//   I, SIMBOLO DESLOC MODULO  tabela de indireção (ligador -l)
+//   R, 0000002A 00000000 ...  bits de relocação, 32 palavras por grupo em
+//   10 7 1 17 ...             hexadecimal (bit k do grupo g = palavra 32g+k)
+//
+//   S, TAMANHO                módulo compartilhado (ligador -s):
+//   D, SIMBOLO ENDERECO       definições exportadas
+//   R, ...                    bits de relocação e código, como acima
+void read_header(FILE *fp, const char *filename, Image *img)
+{
+    snprintf(img->name, sizeof(img->name), "%s", filename);
+    img->kind = 0;
+    img->size = 0;
+    img->bitmap = NULL;
+    img->export_count = img->needed_count = img->import_count = 0;
+
+    int c;
+    while((c = getc(fp)) != EOF) {
+        if(c == '\n' || c == '\r' || c == ' ' || c == '\t') continue;
+
+        // Linha de código: fim do cabeçalho
+        if(c == '-' || (c >= '0' && c <= '9')) {
+            ungetc(c, fp);
+            break;
+        }
+
+        if(getc(fp) != ',' || (c != 'E' && c != 'S' && !img->kind)) {
+            fprintf(stderr, "Erro: cabeçalho inválido em %s.\n", filename);
+            exit(1);
+        }
+
+        switch(c) {
+            case 'E':
+            case 'S':
+                if(fscanf(fp, "%d", &img->size) != 1 || img->size < 0) {
+                    fprintf(stderr, "Erro: cabeçalho inválido em %s.\n", filename);
+                    exit(1);
+                }
+                img->kind = c;
+                break;
+            case 'D': {
+                if(img->export_count >= MAX_SYM) error_exit("Definições demais no módulo compartilhado.");
+                Export *e = &img->exports[img->export_count++];
+                if(fscanf(fp, " %49s %d", e->symbol, &e->address) != 2) {
+                    fprintf(stderr, "Erro: definição inválida em %s.\n", filename);
+                    exit(1);
+                }
+                break;
+            }
+            case 'N':
+                if(img->needed_count >= MAX_SHARED) error_exit("Módulos compartilhados demais.");
+                if(fscanf(fp, " %255s", img->needed[img->needed_count++]) != 1) {
+                    fprintf(stderr, "Erro: módulo compartilhado inválido em %s.\n", filename);
+                    exit(1);
+                }
+                break;
+            case 'I': {
+                if(img->import_count >= MAX_SYM) error_exit("Tabela de indireção cheia.");
+                Import *imp = &img->imports[img->import_count++];
+                if(fscanf(fp, " %49s %d %d", imp->symbol, &imp->addend, &imp->lib) != 3 ||
+                   imp->lib < 0 || imp->lib >= img->needed_count) {
+                    fprintf(stderr, "Erro: entrada de indireção inválida em %s.\n", filename);
+                    exit(1);
+                }
+                imp->bound = 0;
+                break;
+            }
+            case 'R': {
+                int groups = (img->size + 31) / 32;
+                img->bitmap = calloc(groups ? groups : 1, sizeof(uint32_t));
+                if(!img->bitmap) error_exit("Memória insuficiente.");
+                for(int g = 0; g < groups; g++) {
+                    unsigned value;
+                    if(fscanf(fp, "%x", &value) != 1) {
+                        fprintf(stderr, "Erro: bits de relocação inválidos em %s.\n", filename);
+                        exit(1);
+                    }
+                    img->bitmap[g] = value;
+                }
+                break;
+            }
+            default:
+                fprintf(stderr, "Erro: linha '%c,' desconhecida em %s.\n", c, filename);
+                exit(1);
+        }
+    }
+
+    if(img->kind && !img->bitmap) {
+        fprintf(stderr, "Erro: faltam os bits de relocação em %s.\n", filename);
+        exit(1);
+    }
+}
+
+// Lê o código da imagem para a memória a partir de img->base e aplica a
+// relocação
+void read_code(FILE *fp, Machine *m, Image *img)
+{
+    int base = img->base;
+    int size = 0;
+    int value;
+    while(fscanf(fp, "%d", &value) == 1) {
+        if(base + size >= MAX_MEMORY) {
+            fprintf(stderr, "Erro: %s não cabe na memória a partir de %d.\n", img->name, base);
+            exit(1);
+        }
+        m->memory[base + size] = value;
+        size++;
+    }
+    if(!feof(fp)) {
+        fprintf(stderr, "Erro: valor inválido em %s.\n", img->name);
+        exit(1);
+    }
+
+    if(img->kind) {
+        if(size != img->size) {
+            fprintf(stderr, "Erro: %s tem %d palavras, mas o cabeçalho declara %d.\n",
+                    img->name, size, img->size);
+            exit(1);
+        }
+        relocate_image(&m->memory[base], img->bitmap, size, base);
+        free(img->bitmap);
+        img->bitmap = NULL;
+    }
+    img->size = size;
+}
+
+// Carrega um executável na memória a partir de 'base'
+void load_executable(Machine *m, const char *filename, int base, Image *prog)
+{
+    FILE *fp = fopen(filename, "r");
+    if(!fp) {
+        fprintf(stderr, "Erro ao abrir arquivo %s\n", filename);
+        exit(1);
+    }
+
+    read_header(fp, filename, prog);
+    if(prog->kind == 'S') {
+        fprintf(stderr, "Erro: %s é um módulo compartilhado, não um executável.\n", filename);
+        exit(1);
+    }
+    if(!prog->kind && base != 0) {
+        fprintf(stderr, "Erro: %s não é relocável (gere com ligador -r) e só pode ser carregado no endereço 0.\n",
+                filename);
+        exit(1);
+    }
+    if(base + prog->size > MAX_MEMORY) {
+        fprintf(stderr, "Erro: %s não cabe na memória a partir de %d.\n", filename, base);
+        exit(1);
+    }
+
+    prog->base = base;
+    read_code(fp, m, prog);
+    fclose(fp);
+    jump_target[base] = 1;
+    scan_jump_targets(m->memory, base, prog->size);
+}
+
+// Devolve o módulo compartilhado 'filename', carregando-o no topo da
+// memória na primeira vez; os usos seguintes, de qualquer programa,
+// reaproveitam a mesma cópia
+Image *load_shared(Machine *m, const char *filename)
+{
+    for(int i = 0; i < shared_count; i++) {
+        if(strcmp(shared_modules[i].name, filename) == 0) return &shared_modules[i];
+    }
+    if(shared_count >= MAX_SHARED) error_exit("Módulos compartilhados demais.");
+
+    FILE *fp = fopen(filename, "r");
+    if(!fp) {
+        fprintf(stderr, "Erro ao abrir arquivo %s\n", filename);
+        exit(1);
+    }
+
+    Image *lib = &shared_modules[shared_count];
+    read_header(fp, filename, lib);
+    if(lib->kind != 'S') {
+        fprintf(stderr, "Erro: %s não é um módulo compartilhado (gere com ligador -s).\n", filename);
+        exit(1);
+    }
+    if(shared_start - lib->size < program_end) {
+        fprintf(stderr, "Erro: memória insuficiente para o módulo compartilhado %s.\n", filename);
+        exit(1);
+    }
+
+    shared_start -= lib->size;
+    lib->base = shared_start;
+    read_code(fp, m, lib);
+    fclose(fp);
+    shared_count++;
+
+    // Os símbolos exportados podem ser destino de salto de outros módulos
+    scan_jump_targets(m->memory, lib->base, lib->size);
+    for(int i = 0; i < lib->export_count; i++) {
+        int addr = lib->base + lib->exports[i].address;
+        if(addr >= 0 && addr < MAX_MEMORY) jump_target[addr] = 1;
+    }
+    return lib;
+}
+
+// Liga a entrada 'index' da tabela de indireção de 'prog' (no primeiro
+// uso) e devolve o endereço absoluto do símbolo
+int bind_import(Machine *m, Image *prog, int index)
+{
+    Import *imp = &prog->imports[index];
+    if(!imp->bound) {
+        Image *lib = load_shared(m, prog->needed[imp->lib]);
+        int found = 0;
+        for(int i = 0; i < lib->export_count; i++) {
+            if(strcasecmp(lib->exports[i].symbol, imp->symbol) == 0) {
+                imp->address = lib->base + lib->exports[i].address + imp->addend;
+                found = 1;
+                break;
+            }
+        }
+        if(!found) {
+            fprintf(stderr, "ERRO: Símbolo '%s' não exportado por %s.\n", imp->symbol, lib->name);
+            exit(1);
+        }
+        imp->bound = 1;
+    }
+    return imp->address;
+}
+
+// Soma 'base' às palavras marcadas no mapa de bits, numa única passagem
+// sem desvios: cada grupo de bits vira uma máscara (0 ou -1 por palavra)
+// e a máscara AND base é somada às palavras, 8 (AVX2) ou 4 (SSE2) por vez
+void relocate_image(int *words, const uint32_t *bitmap, int size, int base)
+{
+    if(base == 0) return;
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i bit_select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256i base_vec = _mm256_set1_epi32(base);
+    for(; i + 8 <= size; i += 8) {
+        int bits = (int)((bitmap[i / 32] >> (i % 32)) & 0xFF);
+        __m256i mask = _mm256_and_si256(_mm256_set1_epi32(bits), bit_select);
+        mask = _mm256_cmpeq_epi32(mask, bit_select);
+        __m256i w = _mm256_loadu_si256((const __m256i *)(words + i));
+        w = _mm256_add_epi32(w, _mm256_and_si256(mask, base_vec));
+        _mm256_storeu_si256((__m256i *)(words + i), w);
+    }
+#elif defined(__SSE2__)
+    const __m128i bit_select = _mm_setr_epi32(1, 2, 4, 8);
+    const __m128i base_vec = _mm_set1_epi32(base);
+    for(; i + 4 <= size; i += 4) {
+        int bits = (int)((bitmap[i / 32] >> (i % 32)) & 0xF);
+        __m128i mask = _mm_and_si128(_mm_set1_epi32(bits), bit_select);
+        mask = _mm_cmpeq_epi32(mask, bit_select);
+        __m128i w = _mm_loadu_si128((const __m128i *)(words + i));
+        w = _mm_add_epi32(w, _mm_and_si128(mask, base_vec));
+        _mm_storeu_si128((__m128i *)(words + i), w);
+    }
+#endif
+
+    // Palavras restantes (ou todas, sem SIMD)
+    for(; i < size; i++) {
+        int bit = (int)((bitmap[i / 32] >> (i % 32)) & 1);
+        words[i] += base & -bit;
+    }
+}
+
+// Lê o endereço de operando em 'pc' e verifica se está dentro da memória.
+// Um valor negativo -(i+1) é a entrada i da tabela de indireção do programa
+// em execução: o símbolo é ligado e a palavra é corrigida, de modo que as
+// próximas execuções da instrução não passam mais por aqui
+static int operand_at(Machine *m, int pc)
+{
+    int addr = m->memory[pc];
+    if(addr < 0 && running && -addr - 1 < running->import_count) {
+        addr = bind_import(m, running, -addr - 1);
+        store_word(m->memory, pc, addr);
+    }
+    if(addr < 0 || addr >= MAX_MEMORY) {
+        fprintf(stderr, "ERRO: Acesso fora da memória (%d) no endereço %d.\n", addr, pc);
+        exit(1);
+    }
+    return addr;
+}
+
+// Tamanho em palavras da instrução com o opcode dado (0 se inválido)
+static int instruction_words(int op)
+{
+    if(op < OP_ADD || op > OP_STOP) return 0;
+    return op == OP_COPY ? 3 : op == OP_STOP ? 1 : 2;
+}
+
+// Marca os destinos dos saltos de uma imagem carregada, percorrendo-a como
+// uma sequência de instruções. Dados no meio podem gerar destinos a mais, o
+// que só impede fusões; um destino que escape da varredura continua correto,
+// porque cada endereço tem a sua própria entrada pré-decodificada.
+void scan_jump_targets(const int *memory, int base, int size)
+{
+    int end = base + size;
+    for(int addr = base; addr < end; ) {
+        int op = memory[addr];
+        int words = instruction_words(op);
+        if(words == 0) {
+            addr++;
+            continue;
+        }
+        if(op >= OP_JMP && op <= OP_JMPZ && addr + 1 < end) {
+            int target = memory[addr + 1];
+            if(target >= 0 && target < MAX_MEMORY) jump_target[target] = 1;
+        }
+        addr += words;
+    }
+}
+
+// Verifica se a superinstrução 'super' casa com o código a partir de 'pc':
+// mesmas instruções, operandos dentro da memória e nenhum destino de salto
+// depois da primeira. Devolve as palavras cobertas (0 se não casa).
+static int match_super(const int *memory, int pc, const Superinstruction *super, int *operands)
+{
+    int addr = pc;
+    for(int k = 0; k < super->length; k++) {
+        if(addr + 1 >= MAX_MEMORY || memory[addr] != super->ops[k]) return 0;
+        if(k > 0 && jump_target[addr]) return 0;
+        int operand = memory[addr + 1];
+        if(operand < 0 || operand >= MAX_MEMORY) return 0;
+        operands[k] = operand;
+        addr += 2;
+    }
+    return addr - pc;
+}
+
+// Pré-decodifica a instrução em 'pc' na primeira vez que é executada,
+// fundindo-a com as seguintes numa superinstrução quando possível
+void decode_at(const int *memory, int pc)
+{
+    Decoded *d = &decoded[pc];
+    int op = memory[pc];
+    int words = instruction_words(op);
+
+    d->op = OP_GENERIC;
+    d->words = 1;
+    d->count = 1;
+    d->a = d->b = d->c = 0;
+    if(words == 0 || pc + words > MAX_MEMORY) return;
+
+    // Operandos negativos (indireção ainda não ligada) ou fora da memória
+    // ficam para OP_GENERIC, que os trata como a execução sem pré-decodificação
+    int operands[2] = {0, 0};
+    for(int k = 1; k < words; k++) {
+        operands[k - 1] = memory[pc + k];
+        if(operands[k - 1] < 0 || operands[k - 1] >= MAX_MEMORY) return;
+    }
+    d->op = op;
+    d->words = words;
+    d->a = operands[0];
+    d->b = operands[1];
+
+    if(fusion_enabled) {
+        int fused[3];
+        for(int i = 0; i < SUPER_COUNT; i++) {
+            if(fusion_planned && fusion_plan[pc] != i + 1) continue;
+            int fused_words = match_super(memory, pc, &superinstructions[i], fused);
+            if(fused_words) {
+                d->op = superinstructions[i].op;
+                d->words = fused_words;
+                d->count = superinstructions[i].length;
+                d->a = fused[0];
+                d->b = fused[1];
+                d->c = fused[2];
+                super_sites[i]++;
+                break;
+            }
+        }
+    }
+
+    for(int k = 0; k < d->words; k++) code_word[pc + k] = 1;
+}
+
+// Uma escrita em 'addr' mudou código já pré-decodificado: descarta as
+// entradas que cobrem a palavra, que serão decodificadas de novo
+void invalidate_code(int addr)
+{
+    int first = addr - MAX_FUSED_WORDS + 1;
+    for(int start = first < 0 ? 0 : first; start <= addr; start++) {
+        if(decoded[start].op != OP_UNDECODED && start + decoded[start].words > addr) {
+            decoded[start].op = OP_UNDECODED;
+        }
+    }
+    code_word[addr] = 0;
+}
+
+// Candidata a superinstrução no plano guiado por perfil
+typedef struct {
+    int pc;
+    int super;
+    int words;
+    unsigned long long saved;   // Despachos economizados: execuções * (instruções - 1)
+} FusionCandidate;
+
+static int compare_candidates(const void *a, const void *b)
+{
+    const FusionCandidate *x = a, *y = b;
+    if(x->saved != y->saved) return x->saved < y->saved ? 1 : -1;
+    return x->pc - y->pc;
+}
+
+// -F: lê o perfil ("ENDERECO CONTAGEM", relativo ao início do programa,
+// como gravado por -p) e escolhe as superinstruções do programa: todas as
+// sequências da tabela que casam em endereços executados são candidatas, e
+// são aceitas em ordem de despachos economizados, sem sobreposição
+void plan_fusion(const int *memory, const Image *prog, const char *filename)
+{
+    static unsigned long long counts[MAX_MEMORY];
+    static FusionCandidate candidates[MAX_MEMORY];
+    static unsigned char covered[MAX_MEMORY];
+
+    FILE *fp = fopen(filename, "r");
+    if(!fp) {
+        fprintf(stderr, "Erro ao abrir o perfil %s\n", filename);
+        exit(1);
+    }
+    long addr;
+    unsigned long long count;
+    while(fscanf(fp, "%ld %llu", &addr, &count) == 2) {
+        if(addr >= 0 && addr < prog->size) counts[prog->base + addr] += count;
+    }
+    fclose(fp);
+
+    int candidate_count = 0;
+    int end = prog->base + prog->size;
+    for(int pc = prog->base; pc < end; ) {
+        int words = instruction_words(memory[pc]);
+        if(words == 0) {
+            pc++;
+            continue;
+        }
+        for(int i = 0; counts[pc] > 0 && i < SUPER_COUNT; i++) {
+            int operands[3];
+            int fused_words = match_super(memory, pc, &superinstructions[i], operands);
+            if(fused_words && pc + fused_words <= end) {
+                FusionCandidate *c = &candidates[candidate_count++];
+                c->pc = pc;
+                c->super = i;
+                c->words = fused_words;
+                c->saved = counts[pc] * (superinstructions[i].length - 1);
+            }
+        }
+        pc += words;
+    }
+
+    qsort(candidates, candidate_count, sizeof(FusionCandidate), compare_candidates);
+    for(int i = 0; i < candidate_count; i++) {
+        const FusionCandidate *c = &candidates[i];
+        int free_words = 1;
+        for(int k = 0; k < c->words && free_words; k++) free_words = !covered[c->pc + k];
+        if(!free_words) continue;
+        memset(&covered[c->pc], 1, c->words);
+        fusion_plan[c->pc] = (unsigned char)(c->super + 1);
+    }
+    fusion_planned = 1;
+}
+
+// Executa o programa a partir do seu início até STOP
+void run_program(Machine *m, Image *prog)
+{
+    m->pc = prog->base;
+    m->acc = 0;
+    resume_program(m, prog);
+}
+
+// Continua a execução a partir de m->pc até STOP
+// ADD/SUB/MULT/DIV/LOAD operam sobre o acumulador; JMPN/JMPP/JMPZ testam o
+// acumulador; INPUT lê um inteiro da entrada padrão e OUTPUT o escreve.
+// Cada despacho executa a entrada pré-decodificada do endereço, que pode ser
+// uma superinstrução; d->count mantém a contagem em instruções da máquina.
+void resume_program(Machine *m, Image *prog)
+{
+    running = prog;
+    // PC, ACC e os contadores ficam em variáveis locais (em registradores)
+    // e voltam para a máquina nas paradas e no STOP
+    int pc = m->pc;
+    int acc = m->acc;
+    unsigned long long count = executed;
+    unsigned long long dispatched = dispatches;
+    unsigned long long stop_at = checkpoint_at;
+    int *memory = m->memory;
+
+    for(;;) {
+        if(pc < 0 || pc >= MAX_MEMORY) {
+            fprintf(stderr, "ERRO: PC fora da memória (%d).\n", pc);
+            exit(1);
+        }
+
+        // Ponto de restauração, sempre entre dois despachos. Um único
+        // contador cobre a gravação periódica e a verificação de sinais.
+        if(count >= stop_at) {
+            m->pc = pc;
+            m->acc = acc;
+            executed = count;
+            dispatches = dispatched;
+            checkpoint_stop(m);
+            stop_at = checkpoint_at;
+        }
+
+        const Decoded *d = &decoded[pc];
+        if(d->op == OP_UNDECODED) decode_at(memory, pc);
+        count += d->count;
+        dispatched++;
+        if(profile_counts) profile_counts[pc]++;
+
+        switch(d->op) {
+            // Aritmética em 32 bits com estouro circular (sem comportamento indefinido)
+            case OP_ADD:  acc = (int)((unsigned)acc + (unsigned)memory[d->a]); pc += 2; break;
+            case OP_SUB:  acc = (int)((unsigned)acc - (unsigned)memory[d->a]); pc += 2; break;
+            case OP_MULT: acc = (int)((unsigned)acc * (unsigned)memory[d->a]); pc += 2; break;
+            case OP_DIV: {
+                int divisor = memory[d->a];
+                if(divisor == 0) {
+                    fprintf(stderr, "ERRO: Divisão por zero no endereço %d.\n", pc);
+                    exit(1);
+                }
+                acc = (divisor == -1) ? (int)(0u - (unsigned)acc) : acc / divisor;
+                pc += 2;
+                break;
+            }
+            case OP_JMP:  pc = d->a; break;
+            case OP_JMPN: pc = (acc < 0)  ? d->a : pc + 2; break;
+            case OP_JMPP: pc = (acc > 0)  ? d->a : pc + 2; break;
+            case OP_JMPZ: pc = (acc == 0) ? d->a : pc + 2; break;
+            case OP_COPY: {
+                int value = memory[d->a];
+                int dst = d->b;
+                pc += 3;
+                store_word(memory, dst, value);
+                break;
+            }
+            case OP_LOAD: acc = memory[d->a]; pc += 2; break;
+            case OP_STORE: {
+                int dst = d->a;
+                pc += 2;
+                store_word(memory, dst, acc);
+                break;
+            }
+            case OP_INPUT: {
+                int value;
+                if(input.next == input.count) {
+                    // A leitura pode esperar pela entrada: um sinal durante a
+                    // espera grava o estado de antes deste INPUT
+                    m->pc = pc;
+                    m->acc = acc;
+                    executed = count - 1;
+                    dispatches = dispatched - 1;
+                    input_machine = m;
+                }
+                if(!read_input(&value)) {
+                    flush_output();
+                    fprintf(stderr, "ERRO: Fim da entrada em INPUT no endereço %d.\n", pc);
+                    exit(1);
+                }
+                int dst = d->a;
+                pc += 2;
+                store_word(memory, dst, value);
+                break;
+            }
+            case OP_OUTPUT: write_output(memory[d->a]); pc += 2; break;
+            case OP_STOP:
+                m->pc = pc;
+                m->acc = acc;
+                executed = count;
+                dispatches = dispatched;
+                return;
+
+            // Superinstruções: a escrita ou o salto é sempre o último passo
+            case OP_LOAD_ADD_STORE: {
+                int dst = d->c;
+                acc = (int)((unsigned)memory[d->a] + (unsigned)memory[d->b]);
+                pc += 6;
+                store_word(memory, dst, acc);
+                break;
+            }
+            case OP_LOAD_SUB_STORE: {
+                int dst = d->c;
+                acc = (int)((unsigned)memory[d->a] - (unsigned)memory[d->b]);
+                pc += 6;
+                store_word(memory, dst, acc);
+                break;
+            }
+            case OP_LOAD_SUB_JMPZ:
+                acc = (int)((unsigned)memory[d->a] - (unsigned)memory[d->b]);
+                pc = (acc == 0) ? d->c : pc + 6;
+                break;
+            case OP_LOAD_SUB_JMPN:
+                acc = (int)((unsigned)memory[d->a] - (unsigned)memory[d->b]);
+                pc = (acc < 0) ? d->c : pc + 6;
+                break;
+            case OP_LOAD_SUB_JMPP:
+                acc = (int)((unsigned)memory[d->a] - (unsigned)memory[d->b]);
+                pc = (acc > 0) ? d->c : pc + 6;
+                break;
+            case OP_LOAD_ADD: acc = (int)((unsigned)memory[d->a] + (unsigned)memory[d->b]); pc += 4; break;
+            case OP_LOAD_SUB: acc = (int)((unsigned)memory[d->a] - (unsigned)memory[d->b]); pc += 4; break;
+            case OP_LOAD_STORE: {
+                int dst = d->b;
+                acc = memory[d->a];
+                pc += 4;
+                store_word(memory, dst, acc);
+                break;
+            }
+            case OP_ADD_STORE: {
+                int dst = d->b;
+                acc = (int)((unsigned)acc + (unsigned)memory[d->a]);
+                pc += 4;
+                store_word(memory, dst, acc);
+                break;
+            }
+            case OP_SUB_STORE: {
+                int dst = d->b;
+                acc = (int)((unsigned)acc - (unsigned)memory[d->a]);
+                pc += 4;
+                store_word(memory, dst, acc);
+                break;
+            }
+            case OP_LOAD_JMPZ: acc = memory[d->a]; pc = (acc == 0) ? d->b : pc + 4; break;
+            case OP_LOAD_JMPN: acc = memory[d->a]; pc = (acc < 0)  ? d->b : pc + 4; break;
+            case OP_LOAD_JMPP: acc = memory[d->a]; pc = (acc > 0)  ? d->b : pc + 4; break;
+
+            // Opcode inválido ou operando que não é um endereço: um salto
+            // condicional não tomado só avança; nos demais casos operand_at
+            // liga a indireção (ou termina com erro) e a instrução é
+            // decodificada de novo, sem contar como executada
+            case OP_GENERIC: {
+                int op = memory[pc];
+                int words = instruction_words(op);
+                if(words == 0) {
+                    fprintf(stderr, "ERRO: Opcode inválido %d no endereço %d.\n", op, pc);
+                    exit(1);
+                }
+                if((op == OP_JMPN && acc >= 0) || (op == OP_JMPP && acc <= 0) ||
+                   (op == OP_JMPZ && acc != 0)) {
+                    pc += 2;
+                    break;
+                }
+                if(pc + words > MAX_MEMORY) {
+                    fprintf(stderr, "ERRO: Instrução incompleta no fim da memória (endereço %d).\n", pc);
+                    exit(1);
+                }
+                if(op == OP_INPUT) {
+                    // A leitura vem antes da verificação do operando
+                    int value;
+                    if(input.next == input.count) {
+                        m->pc = pc;
+                        m->acc = acc;
+                        executed = count - 1;
+                        dispatches = dispatched - 1;
+                        input_machine = m;
+                    }
+                    if(!read_input(&value)) {
+                        flush_output();
+                        fprintf(stderr, "ERRO: Fim da entrada em INPUT no endereço %d.\n", pc);
+                        exit(1);
+                    }
+                    int dst = operand_at(m, pc + 1);
+                    pc += 2;
+                    store_word(memory, dst, value);
+                    break;
+                }
+                // Mesma ordem da execução: o destino de COPY antes da origem
+                for(int k = words - 1; k >= 1; k--) operand_at(m, pc + k);
+                decode_at(memory, pc);
+                count--;
+                dispatched--;
+                if(profile_counts) profile_counts[pc]--;
+                break;
+            }
+        }
+    }
+}
+
+// Função auxiliar para exibir erro e encerrar o programa
+void error_exit(const char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}